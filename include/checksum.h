@@ -0,0 +1,32 @@
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include "simulator.h"
+
+/* Checksum over a packet's seqnum, acknum and length bytes of payload, */
+/* in that order.                                                        */
+/*   CHECKSUM_SUM:    the signed sum of the fields and payload bytes the */
+/*                    protocols always used.  It misses any corruption   */
+/*                    that keeps the sum, e.g. two bytes swapping places. */
+/*   CHECKSUM_INET:   the ones' complement sum of 16-bit words (RFC 1071) */
+/*                    of IP, UDP and TCP.                                 */
+/*   CHECKSUM_CRC32C: the Castagnoli CRC of iSCSI and SCTP, with the     */
+/*                    SSE 4.2 crc32 instruction where the CPU has it and */
+/*                    a table otherwise.  Both give the same value.       */
+enum checksum_type { CHECKSUM_SUM, CHECKSUM_INET, CHECKSUM_CRC32C, CHECKSUM_TYPES };
+
+extern const char *const checksum_names[CHECKSUM_TYPES];
+
+/* "sum", "inet" or "crc32c"; false for any other name */
+bool checksum_type_of(const char *name, enum checksum_type *type);
+
+int make_checksum(enum checksum_type type, const struct pkt &pkt);
+
+inline bool is_corrupt(enum checksum_type type, const struct pkt &pkt) {
+    return make_checksum(type, pkt) != pkt.checksum;
+}
+
+/* how CRC32C is computed on this CPU: "sse4.2" or "table" */
+const char *crc32c_implementation();
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef COALESCE_H_
+#define COALESCE_H_
+
+#include <cstring>
+
+#include "simulator.h"
+#include "window.h"
+
+/* Coalesced payloads, for the option coalesce of gbn and sr: a count   */
+/* byte, then each message as a 2-byte length (low byte first) and its  */
+/* bytes.  The count is never 0, so the packet still reads as data,     */
+/* nor 255, which marks FEC parity (see fec.h).  The packet's msgid is  */
+/* that of the first message.  Every message a sender takes goes        */
+/* through its queue in order, so the others follow it one by one.      */
+enum { COALESCE_MAX = 254, COALESCE_HEADER = 1, COALESCE_RECORD = 2 };
+
+/* how many of the queued messages, from the front, fit in room bytes */
+/* of payload                                                          */
+inline int coalescible(const message_queue &queue, int room)
+{
+    int n = 0, used = COALESCE_HEADER;
+    while ((unsigned long) n < queue.size() && n < COALESCE_MAX
+           && used + COALESCE_RECORD + queue.length(n) <= room)
+        used += COALESCE_RECORD + queue.length(n++);
+    return n;
+}
+
+/* moves n messages from the front of queue into packet's payload; */
+/* the bytes used                                                   */
+inline int coalesce(message_queue &queue, int n, struct pkt *packet)
+{
+    char *payload = packet->payload;
+    int used = COALESCE_HEADER;
+    payload[0] = (char) n;
+    packet->msgid = queue.front().msgid;
+    for (int i = 0; i < n; i++) {
+        const struct msg &message = queue.front();
+        payload[used] = (char) (message.length & 0xff);
+        payload[used + 1] = (char) (message.length >> 8);
+        memcpy(payload + used + COALESCE_RECORD, message.data, message.length);
+        used += COALESCE_RECORD + message.length;
+        queue.pop();
+    }
+    return used;
+}
+
+/* The messages of a coalesced packet, in order.  A record that would */
+/* run past the packet's length ends them.                            */
+class coalesced_messages {
+public:
+    explicit coalesced_messages(const struct pkt &packet)
+            : packet(packet), left((unsigned char) packet.payload[0]), offset(COALESCE_HEADER),
+              msgid(packet.msgid) {}
+
+    /* the next message; false after the last */
+    bool next(const char **data, int *length, msgid_t *id) {
+        if (left == 0 || offset + COALESCE_RECORD > packet.length)
+            return false;
+        int n = (unsigned char) packet.payload[offset] | (unsigned char) packet.payload[offset + 1] << 8;
+        if (offset + COALESCE_RECORD + n > packet.length)
+            return false;
+        *data = packet.payload + offset + COALESCE_RECORD;
+        *length = n;
+        *id = msgid++;
+        offset += COALESCE_RECORD + n;
+        left--;
+        return true;
+    }
+
+private:
+    const struct pkt &packet;
+    int left;
+    int offset;
+    msgid_t msgid;      /* of the next message */
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef CONGESTION_H_
+#define CONGESTION_H_
+
+#include "simulator.h"
+
+/* Congestion window of one sender, in packets, kept between 1 and the  */
+/* -w window.  The protocol reports newly ACKed packets, losses found by */
+/* duplicate ACKs and retransmission timeouts, and keeps no more than    */
+/* window() packets outstanding.  Every change of the window is recorded */
+/* as the "cwnd" series, by sim_stat() and sim_sample().                 */
+class congestion_control {
+public:
+    congestion_control(struct simulation *sim, int AorB, int maxwin)
+            : cwnd(maxwin), ssthresh(maxwin), maxwin(maxwin), sim(sim), AorB(AorB), recorded(maxwin) {}
+
+    virtual ~congestion_control() {}
+
+    void acked(int n) {
+        on_ack(n, get_sim_time(sim));
+        changed();
+    }
+
+    /* once per loss episode, not per duplicate ACK */
+    void lost() {
+        on_loss(get_sim_time(sim));
+        changed();
+    }
+
+    void timeout() {
+        on_timeout(get_sim_time(sim));
+        changed();
+    }
+
+    int window() const {
+        return (int) cwnd;
+    }
+
+    virtual const char *name() const = 0;
+
+protected:
+    double cwnd, ssthresh;
+    const int maxwin;
+
+    virtual void on_ack(int n, simtime_t now) = 0;
+    virtual void on_loss(simtime_t now) = 0;
+    virtual void on_timeout(simtime_t now) = 0;
+
+    /* for controllers that begin below maxwin, e.g. slow start from 1 */
+    void start(double window) {
+        cwnd = window;
+        changed();
+    }
+
+private:
+    struct simulation *const sim;
+    const int AorB;
+    double recorded;
+
+    void changed();
+};
+
+/* "fixed" (the -w window throughout, as without a controller), "aimd"    */
+/* (slow start, then additive increase and multiplicative decrease, as  */
+/* TCP Reno) or "cubic" (slow start, then the CUBIC growth function).   */
+/* Returns NULL for an unknown name.                                     */
+congestion_control *make_congestion_control(const char *name, struct simulation *sim, int AorB, int maxwin);
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef EVENTQUEUE_H_
+#define EVENTQUEUE_H_
+
+#include <vector>
+
+#include "simulator.h"
+
+struct event {
+   simtime_t evtime;       /* event time */
+   unsigned long evseq;    /* insertion order, set by the queue */
+   struct event *prev;     /* queue private: list links */
+   struct event *next;
+   int evtype;             /* event type code */
+   int eventity;           /* entity where event occurs */
+   int evtimer;            /* timer id, -1 for the entity's plain timer */
+   int qindex;             /* queue private: heap slot or calendar bucket */
+   struct pkt pkt;         /* packet (if any) assoc w/ this event; last, */
+                           /* as only the run's MTU of it is allocated    */
+ };
+
+/* Events fire in evtime order.  Events with the same evtime fire in reverse */
+/* insertion order: that is what the original sorted list did (a new event */
+/* goes in front of every event with an equal time) and keeping it makes   */
+/* every backend produce bit-identical runs for a given seed.              */
+inline bool event_before(const struct event *a, const struct event *b)
+{
+    return a->evtime < b->evtime || (a->evtime == b->evtime && a->evseq > b->evseq);
+}
+
+/* The pending event set ("evlist").  Backends own only the links inside */
+/* struct event; allocating and freeing events stays with the caller.    */
+class event_queue {
+public:
+    event_queue() : nextseq(0) {}
+
+    virtual ~event_queue() {}
+
+    /* schedule e, stamping its insertion order */
+    void insert(struct event *e) {
+        e->evseq = nextseq++;
+        push(e);
+    }
+
+    /* remove and return the earliest event, NULL when empty */
+    virtual struct event *pop() = 0;
+
+    /* unlink a pending event, e.g. a cancelled timer */
+    virtual void remove(struct event *e) = 0;
+
+    virtual unsigned long size() const = 0;
+
+    /* append every pending event to out, in no particular order */
+    virtual void collect(std::vector<struct event *> &out) const = 0;
+
+    virtual const char *name() const = 0;
+
+protected:
+    virtual void push(struct event *e) = 0;
+
+private:
+    unsigned long nextseq;
+};
+
+/* Free-list arena for events.  Memory comes from the heap a slab at a */
+/* time and is recycled for the rest of the run, so once the number of */
+/* pending events stops growing no further heap allocation happens.    */
+/* Each event is cut short after the largest packet it has to hold.    */
+class event_pool {
+public:
+    event_pool() : size(sizeof(struct event)), freelist(NULL), nalloc(0), nfree(0), inuse(0), peak(0) {}
+
+    /* events hold packets of up to mtu bytes; before the first alloc() */
+    void set_mtu(int mtu);
+
+    ~event_pool();
+
+    struct event *alloc() {
+        if (freelist == NULL)
+            grow();
+        struct event *e = freelist;
+        freelist = e->next;
+        nalloc++;
+        if (++inuse > peak)
+            peak = inuse;
+        return e;
+    }
+
+    void release(struct event *e) {
+        e->next = freelist;
+        freelist = e;
+        nfree++;
+        inuse--;
+    }
+
+    unsigned long heap_allocations() const {
+        return slabs.size();
+    }
+
+    unsigned long capacity() const;
+
+    unsigned long allocations() const {
+        return nalloc;
+    }
+
+    unsigned long releases() const {
+        return nfree;
+    }
+
+    unsigned long peak_in_use() const {
+        return peak;
+    }
+
+private:
+    enum { FIRST_SLAB = 256 };
+
+    size_t size;               /* bytes per event */
+    std::vector<struct event *> slabs;
+    struct event *freelist;
+    unsigned long nalloc, nfree, inuse, peak;
+
+    void grow();
+};
+
+/* "list" (the original sorted doubly-linked list, O(n) insert),  */
+/* "heap" (binary heap, O(log n)) or "calendar" (calendar queue,  */
+/* O(1) expected).  Returns NULL for an unknown name.             */
+event_queue *make_event_queue(const char *name);
+
+#endif
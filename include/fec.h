@@ -0,0 +1,75 @@
+#ifndef FEC_H_
+#define FEC_H_
+
+#include "simulator.h"
+#include "checksum.h"
+#include "window.h"
+
+/* Forward error correction between a gbn or sr entity and layer 3.     */
+/* After every k data packets sent for the first time the sender sends  */
+/* m XOR parity packets; parity j covers the packets i of the block     */
+/* with i % m == j.  The receiver keeps the data packets it took intact */
+/* and, when a parity packet finds exactly one of its packets missing,  */
+/* rebuilds that one from the parity and the others, so up to m losses */
+/* a block, in different groups, are repaired without a retransmission. */
+/*                                                                      */
+/* A parity packet carries in its header the block's first seqnum, the  */
+/* XOR of the covered acknums and a checksum of its own, in its msgid   */
+/* the XOR of theirs, so a rebuilt packet keeps its own, and in its     */
+/* payload the FEC_MARKER byte, j, the XOR of the covered lengths and   */
+/* the XOR of their payloads, so it is FEC_HEADER bytes longer than the */
+/* longest of them.  A corrupt parity packet rebuilds nothing.  Data    */
+/* packets never start with FEC_MARKER, and ACKs start with '\0'.       */
+enum { FEC_MARKER = 0xff, FEC_HEADER = 4 };
+
+class fec {
+public:
+    fec(struct simulation *sim, int AorB, int k, int m, enum checksum_type checksum);
+
+    /* the largest parity packet for data packets of up to payload bytes; */
+    /* the MTU must take it                                               */
+    static int parity_size(int payload) {
+        return PKT_HEADER + FEC_HEADER + payload;
+    }
+
+    /* a data packet just sent for the first time; sends the parity */
+    /* packets once it completes a block                            */
+    void sent(const struct pkt &packet);
+
+    static bool is_parity(const struct pkt &packet) {
+        return packet.length >= FEC_HEADER && (unsigned char) packet.payload[0] == FEC_MARKER;
+    }
+
+    /* a data packet that arrived intact */
+    void received(const struct pkt &packet);
+
+    /* the packet parity rebuilds, if parity is intact and exactly one */
+    /* of those it covers is missing; rebuilt gets a fresh checksum    */
+    bool recover(const struct pkt &parity, struct pkt *rebuilt);
+
+    /* the data packet seq if it arrived intact lately, or NULL */
+    const struct pkt *stored(seqnum_t seq) const;
+
+private:
+    struct slot {
+        bool valid;
+        struct pkt pkt;     /* last, see packet_window */
+    };
+
+    struct simulation *const sim;
+    const int AorB;
+    const int k, m;
+    const enum checksum_type checksum;
+
+    /* sender: the block so far, folded into its parity packets */
+    int inblock;
+    seqnum_t first;
+    std::vector<struct pkt> parities;
+
+    /* receiver: the last data packets that arrived intact */
+    packet_window<struct slot> recent;
+
+    void send_parity();
+};
+
+#endif
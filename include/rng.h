@@ -0,0 +1,52 @@
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Random number generator owned by one simulation.                      */
+/*   "xoshiro": xoshiro256** (Blackman & Vigna), seeded through          */
+/*              splitmix64.  Stream k starts 2^128 * k draws further on, */
+/*              so runs with the same seed and different streams never   */
+/*              overlap.                                                 */
+/*   "rand":    the glibc rand() sequence srand(seed) gives, kept in     */
+/*              private state, to reproduce results of the original      */
+/*              emulator.  Streams are not supported.                    */
+class rng {
+public:
+    rng();
+
+    /* false if kind names no generator */
+    bool seed(const char *kind, unsigned int seed, unsigned int stream);
+
+    /* n uniform floats in [0,1] */
+    void fill(float *out, unsigned long n);
+
+    const char *name() const;
+
+private:
+    enum { XOSHIRO, RAND } kind;
+    uint64_t s[4];
+    struct random_data compat;
+    char compatstate[128];
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    void jump();
+};
+
+#endif
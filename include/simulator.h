@@ -1,41 +1,329 @@
 #ifndef SIMULATOR_H_
 #define SIMULATOR_H_
 
-#define BIDIRECTIONAL 0
+#include <vector>
+#include <string>
+#include <cstddef>
+
+/* Simulated time.  A double keeps gaps between events and RTT samples */
+/* exact to well under 1e-6 time units up to ~10^9 units, far past     */
+/* where a float clock lets timers collapse together.                  */
+typedef double simtime_t;
+
+/* Largest packet, header included, that -M may set; build with         */
+/* -DMAX_MTU=n for more.  The emulator stores each packet in only as many */
+/* bytes as the run's MTU, so this costs nothing until it is used.        */
+#ifndef MAX_MTU
+#define MAX_MTU 1500
+#endif
+
+/* the header of struct pkt, and the most payload a packet can carry */
+enum { PKT_HEADER = 4 * sizeof(int), MAX_PAYLOAD = MAX_MTU - PKT_HEADER };
+
+/* Which message a msg is: layer 5 numbers each entity's messages from    */
+/* 0, and the emulator times each one's delay by it.  A protocol carries  */
+/* the msgid along with the message's bytes, in struct pkt and wherever   */
+/* it keeps them, and hands it back to tolayer5().  It belongs to the     */
+/* emulator, not to the packet: it adds nothing to pkt_size(), checksums  */
+/* do not cover it and the medium never corrupts it.                      */
+typedef unsigned int msgid_t;
+
+static const msgid_t NO_MSGID = (msgid_t) -1;
 
 /* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
 /* 4 (students' code).  It contains the data (characters) to be delivered */
-/* to layer 5 via the students transport level protocol entities.         */
+/* to layer 5 via the students transport level protocol entities: length  */
+/* bytes of them, 20 unless sim_params.msgsize says otherwise.            */
 struct msg {
-  char data[20];
+  int length;
+  msgid_t msgid;
+  char data[MAX_PAYLOAD];
 };
 
 /* a packet is the data unit passed from layer 4 (students code) to layer */
 /* 3 (teachers code).  Note the pre-defined packet structure, which all   */
-/* students must follow. */
+/* students must follow.  Only the header and length bytes of payload    */
+/* cross layer 3, so a packet received may be no longer than that: copy */
+/* it with copy_pkt(), not as a whole struct.                            */
 struct pkt {
    int seqnum;
    int acknum;
    int checksum;
-   char payload[20];
+   int length;               /* bytes of payload in use */
+   msgid_t msgid;            /* of the message in payload, the first of */
+                             /* several; not sent, see msgid_t           */
+   char payload[MAX_PAYLOAD];
+};
+
+/* bytes of packet in use */
+inline int pkt_size(const struct pkt &packet)
+{
+   return PKT_HEADER + packet.length;
+}
+
+/* bytes of struct pkt that hold a packet of size bytes, header included */
+inline size_t pkt_storage(int size)
+{
+   return offsetof(struct pkt, payload) + size - PKT_HEADER;
+}
+
+void copy_pkt(struct pkt *to, const struct pkt &from);
+
+/* One independent run of the emulator.  All emulator state lives here, */
+/* so any number of simulations can run in one process, one per thread. */
+struct simulation;
+
+/* Implementation framework interface.  A protocol object holds the state */
+/* of both entities for one simulation and reaches the emulator only     */
+/* through its sim pointer.                                               */
+/*                                                                        */
+/* The emulator calls version 2 of the layer 5 and layer 3 entry points, */
+/* A_send(), A_receive() and so on, which take the message or packet by  */
+/* reference: a packet is read in place, in the event that carried it.   */
+/* Unless a protocol overrides them they pass a copy on to the version 1 */
+/* calls, A_output(), A_input() and so on, which take it by value as the */
+/* original framework did.                                               */
+class protocol {
+public:
+    explicit protocol(struct simulation *sim) : sim(sim) {}
+
+    virtual ~protocol() {}
+
+    virtual void A_send(const struct msg &message) { A_output(message); }
+    virtual void A_receive(const struct pkt &packet);
+    virtual void A_timerinterrupt() = 0;
+    virtual void A_timerinterrupt_id(int id) {}
+    virtual void A_init() = 0;
+
+    virtual void B_receive(const struct pkt &packet);
+    virtual void B_init() = 0;
+
+    /* only called in bidirectional runs, see sim_params.bidirectional */
+    virtual void B_send(const struct msg &message) { B_output(message); }
+    virtual void B_timerinterrupt() {}
+    virtual void B_timerinterrupt_id(int id) {}
+
+    /* version 1 */
+    virtual void A_output(struct msg message) {}
+    virtual void A_input(struct pkt packet) {}
+    virtual void B_input(struct pkt packet) {}
+    virtual void B_output(struct msg message) {}
+
+protected:
+    struct simulation *const sim;
 };
 
-/* Implementation framework interface */
-void A_output(struct msg message);
-void B_output(struct msg message);
-void A_input(struct pkt packet);
-void A_timerinterrupt();
-void A_init();
+typedef protocol *(*protocol_factory)(struct simulation *sim);
 
-void B_input(struct pkt packet);
-void B_init();
+/* Each protocol file registers its factory with a static instance: */
+/*   static protocol_registration registration("gbn", make_gbn);   */
+struct protocol_registration {
+    protocol_registration(const char *name, protocol_factory make);
+};
+
+/* the factory registered under name, or the first one registered */
+/* when name is NULL; NULL if there is none                        */
+protocol_factory find_protocol(const char *name);
 
 /* Simulator API */
+void starttimer(struct simulation *sim, int AorB, simtime_t increment);
+void stoptimer(struct simulation *sim, int AorB);
+void starttimer_id(struct simulation *sim, int AorB, int id, simtime_t increment);
+void stoptimer_id(struct simulation *sim, int AorB, int id);
+void tolayer3(struct simulation *sim, int AorB, const struct pkt &packet);
+void tolayer5(struct simulation *sim, int AorB, const char datasent[], int length, msgid_t msgid);
+void tolayer5(struct simulation *sim, int AorB, const char datasent[]);   /* 20 bytes, no msgid */
+int getwinsize(struct simulation *sim);
+int getmtu(struct simulation *sim);       /* largest packet, header included */
+int getmaxmsgsize(struct simulation *sim);   /* largest message from layer 5 */
+simtime_t get_sim_time(struct simulation *sim);
+/* how long ago the other entity's layer 5 handed down message msgid, */
+/* which AorB is about to deliver; -1 if it is delivered already      */
+simtime_t get_msg_age(struct simulation *sim, int AorB, msgid_t msgid);
+int gettrace(struct simulation *sim);
+int getbidirectional(struct simulation *sim);
+
+/* Zero-copy sends: newpacket() returns the packet of the event that will */
+/* carry it across layer 3, pooled like every event.  The sender fills it */
+/* in place and hands it to sendpacket(), after which it belongs to the   */
+/* emulator.  tolayer3() copies the sender's packet into one instead,     */
+/* which a sender that keeps its packets for resending needs anyway: the  */
+/* medium corrupts the copy in flight, not the original.                  */
+struct pkt *newpacket(struct simulation *sim);
+void sendpacket(struct simulation *sim, int AorB, struct pkt *packet);
+
+/* Backpressure to layer 5: a sender that can take no more messages   */
+/* turns it on, and off once it can.  Meanwhile layer 5 keeps making   */
+/* messages on schedule and either holds them, handing them over in    */
+/* order once the sender frees up (sim_params.layer5 "defer"), or      */
+/* drops them ("drop").                                                */
+void setbackpressure(struct simulation *sim, int AorB, int on);
+
+/* A sender that throws away the message layer 5 just handed it, as abt */
+/* does while a packet is in transit, says so: the emulator then stops  */
+/* waiting for it to be delivered, see msgid_t.                         */
+void sim_discard(struct simulation *sim, int AorB);
+
+/* Protocol options, "name[=value],..." from sim_params.options (-P).  */
+/* The first returns the value of name ("" when it has none), or NULL  */
+/* if it is not given; the second its value as a number, or dflt.      */
+const char *getoption(struct simulation *sim, const char *name);
+double getoption(struct simulation *sim, const char *name, double dflt);
+
+/* A protocol that cannot run with its options or the run's MTU says   */
+/* why, printf style, from A_init() or B_init() and returns: the run    */
+/* then ends before the first event, with the reason in                 */
+/* sim_results.error.  Only the first call counts.                      */
+void sim_error(struct simulation *sim, const char *format, ...);
+
+/* Protocol statistics: adds value as one sample of the series name,   */
+/* reported in sim_results.stats.  The series keeps a copy of the name; */
+/* passing the same pointer every time, a literal or a name built once  */
+/* per simulation, finds the series quickest.                           */
+void sim_stat(struct simulation *sim, const char *name, double value);
+
+/* As sim_stat(), and also keeps the distribution of the series, so its */
+/* percentiles are reported as well; for latencies.                      */
+void sim_distribution(struct simulation *sim, const char *name, double value);
+
+/* Protocol time series: value of the series name (a string literal) at */
+/* entity AorB as of now, kept in sim_results.timeseries when            */
+/* sim_params.timeseries is set and dropped otherwise.                   */
+void sim_sample(struct simulation *sim, int AorB, const char *name, double value);
+
+/* The original single-simulation API, for code written against it: each */
+/* call acts on the simulation being run by the calling thread, and times */
+/* are rounded to float as they always were.                              */
 void starttimer(int AorB, float increment);
 void stoptimer(int AorB);
+void starttimer_id(int AorB, int id, float increment);
+void stoptimer_id(int AorB, int id);
 void tolayer3(int AorB, struct pkt packet);
 void tolayer5(int AorB, char datasent[]);
 int getwinsize();
 float get_sim_time();
 
-#endif
\ No newline at end of file
+/* Running simulations */
+struct sim_params {
+   int seed;
+   int winsize;               /* -w */
+   int nsimmax;               /* number of msgs to generate, then stop */
+   float lossprob;            /* probability that a packet is dropped  */
+   float corruptprob;         /* probability that one bit is packet is flipped */
+   float lambda;              /* arrival rate of messages from layer 5 */
+   int trace;
+   const char *queue;         /* event queue backend, see make_event_queue() */
+   const char *rng;           /* "xoshiro" (NULL) or "rand", see rng.h */
+   unsigned int stream;       /* independent stream of the seed, xoshiro only */
+   int profile;               /* time the calls listed in sim_profile_point */
+   int bidirectional;         /* layer 5 at B generates messages too */
+   const char *options;       /* protocol options, see getoption() */
+   int timeseries;            /* keep sim_sample() points */
+   const char *layer5;        /* "defer" (NULL) or "drop", see setbackpressure() */
+   int msgsize;               /* bytes per message from layer 5, 0 for 20 */
+   int msgsize_max;           /* if above msgsize, sizes are drawn uniformly from */
+                              /* msgsize to msgsize_max                          */
+   int mtu;                   /* largest packet, header included; 0 for the */
+                              /* largest message and its header              */
+};
+
+/* Hot functions timed when sim_params.profile is set */
+enum sim_profile_point {
+   PROFILE_INSERTEVENT,
+   PROFILE_TOLAYER3,
+   PROFILE_A_OUTPUT,
+   PROFILE_A_INPUT,
+   PROFILE_B_INPUT,
+   PROFILE_B_OUTPUT,
+   PROFILE_TIMERINTERRUPT,
+   PROFILE_POINTS
+};
+
+extern const char *const sim_profile_names[PROFILE_POINTS];
+
+/* counts for one direction of data transfer */
+struct sim_direction {
+   int application_sent;      /* messages from the sender's layer 5 */
+   long application_bytes_sent;
+   int transport_sent;        /* packets the sender put into layer 3 */
+   int transport_received;    /* packets that reached the receiver's layer 4 */
+   int application_received;  /* messages delivered to the receiver's layer 5 */
+   long application_bytes_received;
+   int application_deferred;  /* messages layer 5 held under backpressure */
+   int application_dropped;   /* messages layer 5 dropped under backpressure */
+};
+
+/* Buckets of a sim_distribution() series: bucket i > 0 counts the  */
+/* samples from 2^((i - 1 - SERIES_BUCKET_ONE) / SERIES_BUCKETS_OCTAVE) */
+/* up to the next bucket, the first and last anything below or above, */
+/* so percentiles are within 1/16 octave (4.4%) from 2^-16 to 2^32.   */
+enum { SERIES_BUCKETS_OCTAVE = 16, SERIES_BUCKET_ONE = 16 * 16,
+       SERIES_BUCKETS = SERIES_BUCKET_ONE + 32 * 16 + 2 };
+
+/* the samples of one sim_stat() series */
+struct sim_series {
+   std::string name;
+   unsigned long count;
+   double sum, sumsq, min, max;
+   std::vector<unsigned long> buckets;  /* empty unless sim_distribution() */
+
+   double mean() const;
+   double deviation() const;    /* standard deviation */
+   bool has_percentiles() const { return !buckets.empty(); }
+   double percentile(double p) const;   /* 0 < p <= 100, within min and max */
+};
+
+/* one sim_sample() point */
+struct sim_point {
+   simtime_t time;
+   int entity;                /* 0 for A, 1 for B */
+   const char *name;
+   double value;
+};
+
+struct sim_results {
+   /* A to B; for bidirectional runs the transport counts include the */
+   /* packets that carry only ACKs for the other direction            */
+   int A_application;
+   int A_transport;
+   int B_transport;
+   int B_application;
+   long A_application_bytes;  /* see sim_direction */
+   long B_application_bytes;
+   int A_deferred;
+   int A_dropped;
+   struct sim_direction B_to_A;   /* all zero unless bidirectional */
+   simtime_t time;            /* simulated time at termination */
+   int nsim;                  /* number of messages from 5 to 4 */
+   int mtu;
+   int ntolayer3;             /* number sent into layer 3 */
+   int nlost;                 /* number lost in media */
+   int ncorrupt;              /* number corrupted by media*/
+   int nscans;                /* full walks over the event list */
+   const char *queue;
+   const char *rng;
+   unsigned long events_allocated;
+   unsigned long events_released;
+   unsigned long events_peak;
+   unsigned long event_heap_allocations;
+   unsigned long event_capacity;
+   unsigned long events_processed;
+   /* with sim_params.profile: calls to each sim_profile_point and the   */
+   /* nanoseconds spent in them, including the calls they make in turn  */
+   unsigned long profile_calls[PROFILE_POINTS];
+   double profile_ns[PROFILE_POINTS];
+   std::vector<struct sim_series> stats;   /* in order of first sample */
+   std::vector<struct sim_point> timeseries;   /* in time order */
+   std::string error;         /* empty unless the run failed, see sim_error() */
+};
+
+/* NULL if params->queue names no event queue, params->rng no generator  */
+/* or stream, or the message sizes do not fit params->mtu or MAX_MTU; the */
+/* reason then goes to *error, if given                                   */
+struct simulation *sim_create(const struct sim_params *params, protocol_factory make,
+                              std::string *error = NULL);
+void sim_run(struct simulation *sim);
+void sim_results(const struct simulation *sim, struct sim_results *results);
+void sim_destroy(struct simulation *sim);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#include "simulator.h"
+#include "checksum.h"
+
+/* The options gbn and sr share, read and checked in one place.  A value */
+/* out of range fails the run with the reason, see sim_error().          */
+struct transport_options {
+    /* Receiver ACK policy: ackevery=k (send an ACK once k >= 1 packets  */
+    /* are unacknowledged), ackdelay=d (or when the oldest of them has   */
+    /* waited d >= 0; alone, always wait) and ackoutoforder (ACK         */
+    /* out-of-order and duplicate packets at once).  The default ACKs    */
+    /* every packet.                                                     */
+    int ackevery;
+    float ackdelay;
+    bool ackoutoforder;
+
+    /* Fast retransmit: fastretransmit=n (resend on the n-th duplicate   */
+    /* ACK, 3 if no value; 0 waits for the timer) and fastrecovery       */
+    /* (implies fastretransmit; until everything outstanding at the fast */
+    /* retransmit is ACKed, further losses are repaired at once).  gbn   */
+    /* goes back over the window, sr resends send_base once n later      */
+    /* packets are ACKed past it.                                        */
+    int dupthresh;
+    bool fastrecovery;
+
+    /* Flow control: sendbuffer=n (at most n >= 1 messages wait for the  */
+    /* window; then backpressure holds off layer 5), rcvbuffer=n (n >= 1 */
+    /* packets the receiver can hold, -w by default) and readdelay=d     */
+    /* (layer 5 reads one message every d >= 0 time units rather than at */
+    /* once).  Pure ACKs advertise the free receive buffer; the sender   */
+    /* keeps one packet out even at zero, as a probe.                    */
+    int sendbuffer;
+    int rcvbuffer;
+    float readdelay;
+
+    /* Coalescing: coalesce=d (0 if no value, d >= 0): queued messages   */
+    /* leave packed into as few packets as the MTU allows (see           */
+    /* coalesce.h), and one that would leave a packet short waits up to  */
+    /* d for more before it goes.  Every data packet is then coalesced,  */
+    /* so each message in it costs 2 bytes more.                         */
+    bool coalescing;
+    float coalescedelay;
+
+    /* Forward error correction: fec=k (4 if no value) and fecparity=m   */
+    /* (1 by default), 1 <= m <= k <= 255: after every k new data        */
+    /* packets go m XOR parity packets, from which the receiver rebuilds */
+    /* up to m packets of the block lost in different groups (see        */
+    /* fec.h).  k is 0 without fec.                                      */
+    int feck, fecm;
+
+    /* cc=fixed|aimd|cubic, see make_congestion_control(); fixed by default */
+    const char *cc;
+
+    /* checksum=sum|inet|crc32c; sum by default */
+    enum checksum_type checksum;
+};
+
+/* Fills in options from the run's; false, with the run failed, if one is */
+/* out of range or names no checksum                                      */
+bool get_transport_options(struct simulation *sim, struct transport_options *options);
+
+/* false, with the run failed, if the MTU cannot take packets of up to   */
+/* payload bytes of data once fec and coalesce have added their headers */
+bool transport_fits_mtu(struct simulation *sim, const struct transport_options &options, int payload);
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef WINDOW_H_
+#define WINDOW_H_
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#include "simulator.h"
+
+/* Sequence numbers run modulo 2^32 and are compared by their signed */
+/* distance, so a connection can carry any number of messages as long */
+/* as fewer than 2^31 are outstanding.  On the wire they travel in the */
+/* int fields of struct pkt.                                           */
+typedef unsigned int seqnum_t;
+
+inline bool seq_before(seqnum_t a, seqnum_t b)
+{
+    return (int) (a - b) < 0;
+}
+
+/* first <= seq < last */
+inline bool seq_between(seqnum_t first, seqnum_t seq, seqnum_t last)
+{
+    return seq - first < last - first;
+}
+
+/* Per-sequence-number state for the packets of one window, kept in a   */
+/* ring of at least winsize slots (a power of two, so slots stay in     */
+/* order across the 2^32 wrap).  Memory is O(window), not O(messages);  */
+/* slot i holds whichever sequence number of the window maps to it.     */
+template <typename T>
+class ring_window {
+public:
+    ring_window() : mask(0), slots(1) {}
+
+    void resize(unsigned int winsize) {
+        unsigned int n = 1;
+        while (n < winsize)
+            n <<= 1;
+        mask = n - 1;
+        slots.assign(n, T());
+    }
+
+    T &operator[](seqnum_t seq) {
+        return slots[seq & mask];
+    }
+
+    const T &operator[](seqnum_t seq) const {
+        return slots[seq & mask];
+    }
+
+    /* ring slot of seq, 0 <= slot < capacity() */
+    unsigned int slot(seqnum_t seq) const {
+        return seq & mask;
+    }
+
+    unsigned int capacity() const {
+        return mask + 1;
+    }
+
+private:
+    unsigned int mask;
+    std::vector<T> slots;
+};
+
+/* A ring_window of plain data that ends in the packet "pkt", cut short  */
+/* after the run's MTU of it as event_pool cuts events, so a wide window */
+/* of small packets stays small.  Fill a slot's packet in place or with  */
+/* copy_pkt(), never by assigning a whole struct pkt or T.               */
+template <typename T>
+class packet_window {
+public:
+    packet_window() : mask(0), size(sizeof(T)), slots(sizeof(T)) {}
+
+    /* slots hold packets of up to mtu bytes */
+    void resize(unsigned int winsize, int mtu) {
+        unsigned int n = 1;
+        while (n < winsize)
+            n <<= 1;
+        mask = n - 1;
+        size_t align = __alignof__(T);
+        size = offsetof(T, pkt) + pkt_storage(mtu);
+        size = std::min((size + align - 1) / align * align, sizeof(T));
+        slots.assign(n * size, 0);
+    }
+
+    T &operator[](seqnum_t seq) {
+        return *(T *) &slots[(seq & mask) * size];
+    }
+
+    const T &operator[](seqnum_t seq) const {
+        return *(const T *) &slots[(seq & mask) * size];
+    }
+
+    /* ring slot of seq, 0 <= slot < capacity() */
+    unsigned int slot(seqnum_t seq) const {
+        return seq & mask;
+    }
+
+    unsigned int capacity() const {
+        return mask + 1;
+    }
+
+private:
+    unsigned int mask;
+    size_t size;               /* bytes per slot */
+    std::vector<char> slots;
+};
+
+/* Messages waiting in order, e.g. for the window to open.  Only the    */
+/* bytes and msgid of each are kept, not a whole struct msg sized for   */
+/* MAX_PAYLOAD, so a long queue of small messages stays small.  front() */
+/* stays valid until the next pop().                                    */
+class message_queue {
+public:
+    message_queue() : cached(false) {}
+
+    void push(const struct msg &message) {
+        lengths.push_back(message.length);
+        msgids.push_back(message.msgid);
+        bytes.insert(bytes.end(), message.data, message.data + message.length);
+    }
+
+    const struct msg &front() {
+        if (!cached) {
+            head.length = lengths.front();
+            head.msgid = msgids.front();
+            std::copy(bytes.begin(), bytes.begin() + head.length, head.data);
+            cached = true;
+        }
+        return head;
+    }
+
+    void pop() {
+        bytes.erase(bytes.begin(), bytes.begin() + lengths.front());
+        lengths.pop_front();
+        msgids.pop_front();
+        cached = false;
+    }
+
+    bool empty() const {
+        return lengths.empty();
+    }
+
+    unsigned long size() const {
+        return lengths.size();
+    }
+
+    /* bytes of the i-th message from the front */
+    int length(unsigned long i) const {
+        return lengths[i];
+    }
+
+private:
+    std::deque<int> lengths;
+    std::deque<msgid_t> msgids;
+    std::deque<char> bytes;
+    struct msg head;
+    bool cached;
+};
+
+#endif
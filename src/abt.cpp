@@ -1,8 +1,10 @@
 #include "../include/simulator.h"
+#include "../include/checksum.h"
 #include <iostream>
 #include <cstring>
 #include <iomanip>
 #include <cmath>
+#include <cstdlib>
 /* ******************************************************************
  ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
 
@@ -17,163 +19,254 @@
 **********************************************************************/
 
 /********* STUDENTS WRITE THE NEXT SEVEN ROUTINES *********/
-#define DEBUG_LOG(AorB, str) do { std::cout << std::setprecision(5) << std::setw(8) << get_sim_time() << "T: " << std::setw(3) << __LINE__  << "L: " << AorB << " : " << str << std::endl; } while( false )
+#define DEBUG_LOG(AorB, str) do { if (gettrace(sim) > 0) std::cout << std::setprecision(5) << std::setw(8) << get_sim_time(sim) << "T: " << std::setw(3) << __LINE__  << "L: " << (AorB) << " : " << str << std::endl; } while( false )
 #define DEBUG_A(str) DEBUG_LOG('A', str)
 #define DEBUG_B(str) DEBUG_LOG('B', str)
+#define DEBUG_SIDE(AorB, str) DEBUG_LOG((AorB) ? 'B' : 'A', str)
 
-std::ostream &operator<<(std::ostream &, const pkt &);
+static std::ostream &operator<<(std::ostream &, const pkt &);
 
-std::ostream &operator<<(std::ostream &, const msg &);
+static void make_pkt(struct pkt *pkt, int seq, int ack, const struct msg *msg, enum checksum_type checksum);
 
-static float initial_rtt = 10.0f,
-        alpha = 0.125f,
-        beta = 0.25f,
-        SampleRTT = initial_rtt,
-        EstimatedRTT = initial_rtt,
-        DevRTT = 0.0f;
+static void make_ack(struct pkt *pkt, int ack, enum checksum_type checksum);
 
-float TimeoutInterval();
+static bool has_data(const struct pkt &pkt);
 
-// A
-static volatile int A_seq = 0;
+class abt : public protocol {
+public:
+    explicit abt(struct simulation *sim);
 
-static pkt *pkt_in_transit = NULL;
-static float sent_time = 0.0f;;
-static bool retransmitted = false;
+    void A_send(const struct msg &message);
 
-// B
-static volatile int B_seq = 0;
+    void A_receive(const struct pkt &packet);
 
-pkt *make_pkt(int seq, int ack, struct msg *msg);
+    void A_timerinterrupt();
 
-pkt *make_ack(int ack);
+    void A_init();
 
-int make_checksum(struct pkt *pkt);
+    void B_receive(const struct pkt &packet);
 
-bool is_corrupt(struct pkt pkt);
+    void B_init();
+
+    void B_send(const struct msg &message);
+
+    void B_timerinterrupt();
+
+private:
+    simtime_t initial_rtt;
+    float alpha,
+            beta;
+
+    /* Each entity sends on its own alternating bit and acknowledges the */
+    /* other's; in bidirectional runs ACKs ride on outgoing data packets. */
+    struct entity {
+        simtime_t SampleRTT,
+                EstimatedRTT,
+                DevRTT;
+
+        // sender
+        int seq;
+        bool in_transit;
+        struct pkt pkt_in_transit;
+        simtime_t sent_time;
+        bool retransmitted;
+
+        // receiver
+        int expected;
+    } side[2];
+
+    /* the option checksum=sum|inet|crc32c; sum by default */
+    enum checksum_type checksum;
+
+    simtime_t TimeoutInterval(int AorB);
+
+    void output(int AorB, const struct msg &message);
+
+    void input(int AorB, const struct pkt &packet);
+
+    void timerinterrupt(int AorB);
+
+    void init();
+};
+
+abt::abt(struct simulation *sim)
+        : protocol(sim),
+          initial_rtt(10.0f), alpha(0.125f), beta(0.25f), checksum(CHECKSUM_SUM) {
+    for (int i = 0; i < 2; i++) {
+        entity &e = side[i];
+        e.SampleRTT = e.EstimatedRTT = initial_rtt;
+        e.DevRTT = 0.0f;
+        e.seq = 0;
+        e.in_transit = false;
+        e.sent_time = 0.0;
+        e.retransmitted = false;
+        e.expected = 0;
+    }
+}
 
 /* called from layer 5, passed the data to be sent to other side */
-void A_output(struct msg message) {
-    if (pkt_in_transit == NULL) {
-        struct pkt *pkt = make_pkt(A_seq, 0, &message);
-        tolayer3(0, *pkt);
+void abt::A_send(const struct msg &message) {
+    output(0, message);
+}
+
+void abt::B_send(const struct msg &message) {
+    output(1, message);
+}
 
-        sent_time = get_sim_time();
-        retransmitted = false;
+void abt::output(int AorB, const struct msg &message) {
+    entity &e = side[AorB];
+    if (!e.in_transit) {
+        make_pkt(&e.pkt_in_transit, e.seq, e.expected ^ 1, &message, checksum);
+        tolayer3(sim, AorB, e.pkt_in_transit);
 
-        starttimer(0, TimeoutInterval());
-        pkt_in_transit = pkt;
+        e.sent_time = get_sim_time(sim);
+        e.retransmitted = false;
+
+        starttimer(sim, AorB, TimeoutInterval(AorB));
+        e.in_transit = true;
+    } else {
+        sim_discard(sim, AorB);
     }
 }
 
 /* called from layer 3, when a packet arrives for layer 4 */
-void A_input(struct pkt packet) {
-    if (!is_corrupt(packet) && packet.acknum == A_seq) {
-        stoptimer(0);
-
-        if (!retransmitted) {
-            SampleRTT = get_sim_time() - sent_time;
-            EstimatedRTT = ((1 - alpha) * EstimatedRTT + (alpha * SampleRTT));
-            DevRTT = ((1 - beta) * DevRTT + (beta * fabsf(SampleRTT - EstimatedRTT)));
+void abt::A_receive(const struct pkt &packet) {
+    input(0, packet);
+}
+
+/* Note that with simplex transfer from a-to-B, there is no B_send() */
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void abt::B_receive(const struct pkt &packet) {
+    input(1, packet);
+}
+
+/* In simplex runs A only takes ACKs and B only takes data, as before. */
+void abt::input(int AorB, const struct pkt &packet) {
+    entity &e = side[AorB];
+    bool bidirectional = getbidirectional(sim);
+    bool corrupt = is_corrupt(checksum, packet);
+    int ack = -1;   /* the ACK to send back, if any */
+
+    // receiver: packets with a payload, and corrupt ones, are answered
+    if ((AorB == 1 || bidirectional) && (corrupt || has_data(packet))) {
+        if (!corrupt && packet.seqnum == e.expected) {
+            ack = e.expected;
+            tolayer5(sim, AorB, packet.payload, packet.length, packet.msgid);
+            // toggle seq
+            e.expected ^= 1;
+        } else if (corrupt || packet.seqnum == (e.expected ^ 1)) {
+            ack = e.expected ^ 1;
         }
+    }
 
-        //  received ack
-        if (pkt_in_transit != NULL) {
-            delete pkt_in_transit;
-            pkt_in_transit = NULL;
+    // sender
+    if ((AorB == 0 || bidirectional) && !corrupt && e.in_transit && packet.acknum == e.seq) {
+        stoptimer(sim, AorB);
+
+        if (!e.retransmitted) {
+            e.SampleRTT = get_sim_time(sim) - e.sent_time;
+            e.EstimatedRTT = ((1 - alpha) * e.EstimatedRTT + (alpha * e.SampleRTT));
+            e.DevRTT = ((1 - beta) * e.DevRTT + (beta * fabs(e.SampleRTT - e.EstimatedRTT)));
+            sim_stat(sim, "rtt_sample", e.SampleRTT);
         }
+
+        //  received ack
+        e.in_transit = false;
         // toggle seq
-        A_seq ^= 1;
+        e.seq ^= 1;
     }
-}
 
-/* called when A's timer goes off */
-void A_timerinterrupt() {
-    if (pkt_in_transit != NULL) {
-        struct pkt packet = (*pkt_in_transit);
-        tolayer3(0, packet);
-        retransmitted = true;
-        DEBUG_A("\033[31;1m" << "TIMEOUT RESENT: " << packet << "\033[0m");
-        starttimer(0, TimeoutInterval() * 2);
+    if (ack >= 0) {
+        struct pkt *ack_pkt = newpacket(sim);
+        make_ack(ack_pkt, ack, checksum);
+        sendpacket(sim, AorB, ack_pkt);
+        sim_stat(sim, "ack", 1);
     }
 }
 
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init() {
+/* called when A's timer goes off */
+void abt::A_timerinterrupt() {
+    timerinterrupt(0);
 }
 
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
+void abt::B_timerinterrupt() {
+    timerinterrupt(1);
+}
 
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet) {
-    bool corrupt = is_corrupt(packet);
-    if (!corrupt && packet.seqnum == B_seq) {
-        pkt *ack_pkt = make_ack(B_seq);
-        tolayer3(1, *ack_pkt);
-        tolayer5(1, packet.payload);
-        // toggle seq
-        B_seq ^= 1;
-        delete ack_pkt;
-    } else if (corrupt || packet.seqnum == (B_seq ^ 1)) {
-        pkt *ack_pkt = make_ack(B_seq ^ 1);
-        tolayer3(1, *ack_pkt);
-        delete ack_pkt;
+void abt::timerinterrupt(int AorB) {
+    entity &e = side[AorB];
+    if (e.in_transit) {
+        sim_stat(sim, "timeout", 1);
+        tolayer3(sim, AorB, e.pkt_in_transit);
+        e.retransmitted = true;
+        DEBUG_SIDE(AorB, "\033[31;1m" << "TIMEOUT RESENT: " << e.pkt_in_transit << "\033[0m");
+        starttimer(sim, AorB, TimeoutInterval(AorB) * 2);
     }
 }
 
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+void abt::A_init() {
+    init();
+}
+
 /* the following rouytine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init() {
+void abt::B_init() {
+    init();
+}
 
+void abt::init() {
+    const char *type = getoption(sim, "checksum");
+    if (type != NULL && !checksum_type_of(type, &checksum))
+        sim_error(sim, "Unknown checksum: %s", type);
 }
 
 
-float TimeoutInterval() {
-    float TimeoutInterval = EstimatedRTT + 4 * DevRTT;
-    DEBUG_A("Estimated TimeoutInterval: " << TimeoutInterval);
+simtime_t abt::TimeoutInterval(int AorB) {
+    simtime_t TimeoutInterval = side[AorB].EstimatedRTT + 4 * side[AorB].DevRTT;
+    DEBUG_SIDE(AorB, "Estimated TimeoutInterval: " << TimeoutInterval);
+    sim_stat(sim, "rto", TimeoutInterval);
     return TimeoutInterval;
 }
 
-pkt *make_pkt(int seq, int ack, struct msg *msg) {
-    struct pkt *pkt = new struct pkt();
+/* fills in pkt where it lies, e.g. in the event that carries it */
+static void make_pkt(struct pkt *pkt, int seq, int ack, const struct msg *msg, enum checksum_type checksum) {
     pkt->seqnum = seq;
     pkt->acknum = ack;
     if (msg != NULL) {
-        memcpy(pkt->payload, (*msg).data, 20);
+        pkt->length = (*msg).length;
+        pkt->msgid = (*msg).msgid;
+        memcpy(pkt->payload, (*msg).data, pkt->length);
+    } else {
+        pkt->length = 1;
+        pkt->payload[0] = '\0';
     }
-    pkt->checksum = make_checksum(pkt);
-    return pkt;
+    pkt->checksum = make_checksum(checksum, *pkt);
 }
 
-int make_checksum(struct pkt *pkt) {
-    int checksum = 0;
-    checksum += pkt->seqnum;
-    checksum += pkt->acknum;
-    for (int i = 0; i < 20; ++i) {
-        checksum += pkt->payload[i];
-    }
-    return checksum;
-}
-
-
-bool is_corrupt(struct pkt pkt) {
-    return make_checksum(&pkt) != pkt.checksum;
+static void make_ack(struct pkt *pkt, int ack, enum checksum_type checksum) {
+    make_pkt(pkt, 0, ack, NULL, checksum);
 }
 
-pkt *make_ack(int ack) {
-    return make_pkt(0, ack, NULL);
+/* ACKs carry no payload but the '\0' that marks them; layer 5 never hands */
+/* down a message starting with '\0'                                       */
+static bool has_data(const struct pkt &pkt) {
+    return pkt.payload[0] != '\0';
 }
 
-std::ostream &operator<<(std::ostream &os, const msg &m) {
-    return os << "{msg: " << std::string(m.data, 20) << '}';
-}
-
-std::ostream &operator<<(std::ostream &os, const pkt &p) {
+static std::ostream &operator<<(std::ostream &os, const pkt &p) {
     os << "{seq: " << p.seqnum << ", ack:" << p.acknum << ", chks:" << p.checksum;
     if (p.payload[0] != '\0') {
-        os << ", payload:" << std::string(p.payload, 20);
+        os << ", payload:" << std::string(p.payload, p.length);
     }
     os << '}';
     return os;
-}
\ No newline at end of file
+}
+
+static protocol *make_abt(struct simulation *sim) {
+    return new abt(sim);
+}
+
+static protocol_registration registration("abt", make_abt);
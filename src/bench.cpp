@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../include/simulator.h"
+#include "../include/checksum.h"
+
+/*
+ * Simulator benchmark: runs abt, gbn and sr through a fixed set of
+ * workloads and reports wall time, events per second, ns per event, peak
+ * RSS and heap allocations per message, plus the time spent per call in
+ * the hot functions and each checksum.  Each scenario runs in a child process so its peak
+ * RSS and allocation count are its own.  Results are written as CSV; given
+ * a previous result file as a baseline, scenarios that got slower or
+ * allocate more than the tolerance allows are flagged and the exit status
+ * is 1.
+ */
+
+struct scenario {
+    const char *name;
+    const char *protocol;
+    int winsize;
+    float lossprob;
+    float corruptprob;
+    float lambda;
+    int nsimmax;
+    int large;                 /* only run with -L */
+};
+
+static const scenario scenarios[] = {
+    {"abt-l0-1e4",          "abt",    1, 0.0f, 0.0f, 20, 10000,    0},
+    {"abt-l0.2-1e5",        "abt",    1, 0.2f, 0.2f, 20, 100000,   0},
+    {"abt-l0.8-1e4",        "abt",    1, 0.8f, 0.0f, 20, 10000,    0},
+    {"abt-l0.2-1e7",        "abt",    1, 0.2f, 0.2f, 20, 10000000, 1},
+    {"gbn-w10-l0-1e4",      "gbn",   10, 0.0f, 0.0f, 20, 10000,    0},
+    {"gbn-w100-l0.2-1e4",   "gbn",  100, 0.2f, 0.2f, 50, 10000,    0},
+    {"gbn-w1000-l0.8-1e4",  "gbn", 1000, 0.8f, 0.0f, 50, 10000,    0},
+    {"gbn-w10-l0.1-1e7",    "gbn",   10, 0.1f, 0.1f, 50, 10000000, 1},
+    {"sr-w10-l0-1e4",       "sr",    10, 0.0f, 0.0f, 20, 10000,    0},
+    {"sr-w100-l0.2-1e5",    "sr",   100, 0.2f, 0.2f, 50, 100000,   0},
+    {"sr-w1000-l0.8-1e4",   "sr",  1000, 0.8f, 0.0f, 50, 10000,    0},
+    {"sr-w100-l0.2-1e7",    "sr",   100, 0.2f, 0.2f, 50, 10000000, 1},
+};
+
+/* what a child sends back to the parent through its pipe */
+struct measurement {
+    double wall;               /* seconds in sim_run(), best of the repeats */
+    unsigned long events;
+    unsigned long allocations; /* operator new calls during sim_run() */
+    int messages;
+    unsigned long profile_calls[PROFILE_POINTS];
+    double profile_ns[PROFILE_POINTS];
+    double checksum_ns[CHECKSUM_TYPES];    /* per call, measured in a tight loop */
+};
+
+struct result {
+    const scenario *s;
+    measurement m;
+    long peak_rss_kb;
+};
+
+static unsigned long nnew = 0;
+
+/* counts every allocation made through new, the containers' included */
+#if __cplusplus >= 201103L
+void *operator new(size_t size) {
+#else
+void *operator new(size_t size) throw(std::bad_alloc) {
+#endif
+    void *p;
+    nnew++;
+    if ((p = malloc(size ? size : 1)) == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+#if __cplusplus >= 201103L
+void operator delete(void *p) noexcept {
+#else
+void operator delete(void *p) throw() {
+#endif
+    free(p);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum { CHECKSUM_PACKETS = 256, CHECKSUM_ROUNDS = 4000 };
+
+static const struct pkt *checksum_packets(enum checksum_type type) {
+    static struct pkt packets[CHECKSUM_PACKETS];
+    for (int i = 0; i < CHECKSUM_PACKETS; i++) {
+        packets[i].seqnum = i;
+        packets[i].acknum = 0;
+        packets[i].length = 20;
+        memset(packets[i].payload, 'a' + i % 26, 20);
+        packets[i].checksum = make_checksum(type, packets[i]);
+    }
+    return packets;
+}
+
+static double time_checksum(enum checksum_type type) {
+    const struct pkt *packets = checksum_packets(type);
+    volatile int sink = 0;
+    double start = now();
+    for (int r = 0; r < CHECKSUM_ROUNDS; r++)
+        for (int i = 0; i < CHECKSUM_PACKETS; i++)
+            sink += make_checksum(type, packets[i]);
+    return (now() - start) * 1e9 / ((double) CHECKSUM_PACKETS * CHECKSUM_ROUNDS);
+}
+
+static struct sim_params params_of(const scenario &s, int profile) {
+    struct sim_params params;
+    memset(&params, 0, sizeof(params));
+    params.seed = 1;
+    params.winsize = s.winsize;
+    params.nsimmax = s.nsimmax;
+    params.lossprob = s.lossprob;
+    params.corruptprob = s.corruptprob;
+    params.lambda = s.lambda;
+    params.queue = "heap";
+    params.profile = profile;
+    return params;
+}
+
+/* the timed runs, then one profiled run for the per-call figures */
+static void measure(const scenario &s, int repeats, measurement *m) {
+    struct sim_results results;
+    struct simulation *sim;
+    struct sim_params params = params_of(s, 0);
+
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < repeats; i++) {
+        sim = sim_create(&params, find_protocol(s.protocol));
+        unsigned long before = nnew;
+        double start = now();
+        sim_run(sim);
+        double wall = now() - start;
+        unsigned long allocations = nnew - before;
+        sim_results(sim, &results);
+        sim_destroy(sim);
+        if (i == 0 || wall < m->wall) {
+            m->wall = wall;
+            m->allocations = allocations;
+        }
+        m->events = results.events_processed;
+        m->messages = results.nsim;
+    }
+
+    params.profile = 1;
+    sim = sim_create(&params, find_protocol(s.protocol));
+    sim_run(sim);
+    sim_results(sim, &results);
+    sim_destroy(sim);
+    for (int p = 0; p < PROFILE_POINTS; p++) {
+        m->profile_calls[p] = results.profile_calls[p];
+        m->profile_ns[p] = results.profile_ns[p];
+    }
+    for (int t = 0; t < CHECKSUM_TYPES; t++)
+        m->checksum_ns[t] = time_checksum((enum checksum_type) t);
+}
+
+/* emulator chatter goes to stdout, so the child's is thrown away */
+static bool run_child(const scenario &s, int repeats, result *r) {
+    int fds[2];
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    if (pipe(fds) != 0 || (pid = fork()) < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        measurement m;
+        close(fds[0]);
+        if (freopen("/dev/null", "w", stdout) == NULL)
+            _exit(1);
+        measure(s, repeats, &m);
+        _exit(write(fds[1], &m, sizeof(m)) == (ssize_t) sizeof(m) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &r->m, sizeof(r->m));
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage) < 0 || n != (ssize_t) sizeof(r->m)
+        || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return false;
+    r->s = &s;
+    r->peak_rss_kb = usage.ru_maxrss;
+    return true;
+}
+
+static double ns_per_event(const result &r) {
+    return r.m.events ? r.m.wall * 1e9 / r.m.events : 0;
+}
+
+static double allocs_per_msg(const result &r) {
+    return r.m.messages ? (double) r.m.allocations / r.m.messages : 0;
+}
+
+static double ns_per_call(const result &r, int point) {
+    return r.m.profile_calls[point] ? r.m.profile_ns[point] / r.m.profile_calls[point] : 0;
+}
+
+static void write_csv(FILE *out, const std::vector<result> &results) {
+    fprintf(out, "scenario,protocol,window,loss,corruption,interval,messages,wall_seconds,events,"
+            "events_per_second,ns_per_event,peak_rss_kb,allocations_per_message");
+    for (int p = 0; p < PROFILE_POINTS; p++)
+        fprintf(out, ",%s_ns", sim_profile_names[p]);
+    fprintf(out, ",make_checksum_ns");     /* the sum, named as it always was */
+    for (int t = 1; t < CHECKSUM_TYPES; t++)
+        fprintf(out, ",%s_checksum_ns", checksum_names[t]);
+    fprintf(out, "\n");
+    for (unsigned long i = 0; i < results.size(); i++) {
+        const result &r = results[i];
+        fprintf(out, "%s,%s,%d,%g,%g,%g,%d,%f,%lu,%.0f,%.2f,%ld,%.3f",
+                r.s->name, r.s->protocol, r.s->winsize, r.s->lossprob, r.s->corruptprob, r.s->lambda,
+                r.m.messages, r.m.wall, r.m.events, r.m.events / r.m.wall, ns_per_event(r),
+                r.peak_rss_kb, allocs_per_msg(r));
+        for (int p = 0; p < PROFILE_POINTS; p++)
+            fprintf(out, ",%.2f", ns_per_call(r, p));
+        for (int t = 0; t < CHECKSUM_TYPES; t++)
+            fprintf(out, ",%.2f", r.m.checksum_ns[t]);
+        fprintf(out, "\n");
+    }
+}
+
+/* scenario -> {ns_per_event, allocations_per_message} of a previous CSV */
+struct baseline_row {
+    std::string name;
+    double ns_per_event;
+    double allocs_per_msg;
+};
+
+static bool read_baseline(const char *path, std::vector<baseline_row> &rows) {
+    FILE *in = fopen(path, "r");
+    char line[1024];
+    if (in == NULL) {
+        perror(path);
+        return false;
+    }
+    if (fgets(line, sizeof(line), in) == NULL) {   /* header */
+        fclose(in);
+        return true;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        std::vector<std::string> fields;
+        std::string s(line);
+        for (std::string::size_type pos = 0; pos <= s.size();) {
+            std::string::size_type end = s.find(',', pos);
+            if (end == std::string::npos)
+                end = s.size();
+            fields.push_back(s.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        if (fields.size() < 13)
+            continue;
+        baseline_row row = {fields[0], atof(fields[10].c_str()), atof(fields[12].c_str())};
+        rows.push_back(row);
+    }
+    fclose(in);
+    return true;
+}
+
+/* number of scenarios that regressed by more than tolerance */
+static int compare(const std::vector<result> &results, const std::vector<baseline_row> &baseline,
+                   double tolerance) {
+    int regressions = 0;
+    for (unsigned long i = 0; i < results.size(); i++) {
+        const result &r = results[i];
+        for (unsigned long j = 0; j < baseline.size(); j++) {
+            const baseline_row &b = baseline[j];
+            if (b.name != r.s->name)
+                continue;
+            double ns = ns_per_event(r), allocs = allocs_per_msg(r);
+            if (ns > b.ns_per_event * (1 + tolerance)) {
+                fprintf(stderr, "REGRESSION %s: %.2f ns/event, baseline %.2f\n", r.s->name, ns, b.ns_per_event);
+                regressions++;
+            } else if (allocs > b.allocs_per_msg * (1 + tolerance) + 1e-9) {
+                fprintf(stderr, "REGRESSION %s: %.3f allocations/message, baseline %.3f\n",
+                        r.s->name, allocs, b.allocs_per_msg);
+                regressions++;
+            }
+        }
+    }
+    return regressions;
+}
+
+static void display_usage(char *filename) {
+    printf("Usage:\n %s [-L] [-k Scenario] [-r Repeats] [-f Output file] [-b Baseline file] [-x Tolerance]\n"
+           " -L adds the 10^7 message scenarios, -k runs only the named scenarios (repeatable).\n"
+           " Timed runs are repeated -r times (default 3) and the fastest kept.  With -b, scenarios\n"
+           " whose ns/event or allocations/message exceed the baseline by more than -x (default\n"
+           " 0.1 = 10%%) are reported on stderr and the exit status is 1.\n",
+           filename);
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> only;
+    const char *path = NULL, *baseline_path = NULL;
+    double tolerance = 0.1;
+    int repeats = 3, large = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "Lk:r:f:b:x:")) != -1) {
+        switch (opt) {
+            case 'L':   large = 1;
+                        break;
+            case 'k':   only.push_back(optarg);
+                        break;
+            case 'r':   repeats = atoi(optarg);
+                        break;
+            case 'f':   path = optarg;
+                        break;
+            case 'b':   baseline_path = optarg;
+                        break;
+            case 'x':   tolerance = atof(optarg);
+                        break;
+            case '?':
+            default:    display_usage(argv[0]);
+                        return -1;
+        }
+    }
+    if (repeats < 1 || tolerance < 0) {
+        display_usage(argv[0]);
+        return -1;
+    }
+
+    std::vector<baseline_row> baseline;
+    if (baseline_path != NULL && !read_baseline(baseline_path, baseline))
+        return -1;
+
+    fprintf(stderr, "crc32c: %s\n", crc32c_implementation());
+    std::vector<result> results;
+    for (unsigned long i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        const scenario &s = scenarios[i];
+        bool wanted = only.empty() ? (!s.large || large) : false;
+        for (unsigned long k = 0; k < only.size(); k++)
+            if (only[k] == s.name)
+                wanted = true;
+        if (!wanted)
+            continue;
+        result r;
+        if (!run_child(s, repeats, &r)) {
+            fprintf(stderr, "%s: run failed\n", s.name);
+            return -1;
+        }
+        fprintf(stderr, "%-16s %10lu events %8.3f s %8.2f ns/event %7ld KB %7.3f allocs/msg\n",
+                s.name, r.m.events, r.m.wall, ns_per_event(r), r.peak_rss_kb, allocs_per_msg(r));
+        results.push_back(r);
+    }
+
+    FILE *out = stdout;
+    if (path != NULL && (out = fopen(path, "w")) == NULL) {
+        perror(path);
+        return -1;
+    }
+    write_csv(out, results);
+    if (out != stdout)
+        fclose(out);
+    return compare(results, baseline, tolerance) ? 1 : 0;
+}
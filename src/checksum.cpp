@@ -0,0 +1,171 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "../include/checksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define HAVE_SSE42_CRC32C 1
+#endif
+
+const char *const checksum_names[CHECKSUM_TYPES] = {"sum", "inet", "crc32c"};
+
+bool checksum_type_of(const char *name, enum checksum_type *type)
+{
+    for (int i = 0; i < CHECKSUM_TYPES; i++)
+        if (strcmp(name, checksum_names[i]) == 0) {
+            *type = (enum checksum_type) i;
+            return true;
+        }
+    return false;
+}
+
+/* payload bytes covered: a corrupt length still reads inside the packet */
+static inline int covered(const struct pkt &pkt)
+{
+    return pkt.length < 0 ? 0 : pkt.length > MAX_PAYLOAD ? MAX_PAYLOAD : pkt.length;
+}
+
+/************************** SUM ***************/
+static int sum_checksum(const struct pkt &pkt)
+{
+    int checksum = 0;
+    checksum += pkt.seqnum;
+    checksum += pkt.acknum;
+    for (int i = 0, n = covered(pkt); i < n; ++i) {
+        checksum += pkt.payload[i];
+    }
+    return checksum;
+}
+
+/************************** INTERNET ***************/
+static uint32_t add_words(uint32_t sum, const void *data, int len)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    int i;
+    for (i = 0; i + 1 < len; i += 2) {
+        uint16_t word;
+        memcpy(&word, p + i, 2);
+        sum += word;
+    }
+    if (i < len) {
+        /* an odd last byte is padded with a zero */
+        uint16_t word = 0;
+        memcpy(&word, p + i, 1);
+        sum += word;
+    }
+    return sum;
+}
+
+static int inet_checksum(const struct pkt &pkt)
+{
+    uint32_t sum = 0;
+    sum = add_words(sum, &pkt.seqnum, 4);
+    sum = add_words(sum, &pkt.acknum, 4);
+    sum = add_words(sum, pkt.payload, covered(pkt));
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t) ~sum;
+}
+
+/************************** CRC32C ***************/
+/* reflected Castagnoli polynomial */
+enum { CRC32C_POLY = 0x82f63b78 };
+
+struct crc32c_table {
+    uint32_t entry[256];
+
+    crc32c_table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; k++)
+                crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            entry[i] = crc;
+        }
+    }
+};
+
+static const crc32c_table table;
+
+static uint32_t crc32c_bytes(uint32_t crc, const void *data, int len)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    for (int i = 0; i < len; i++)
+        crc = table.entry[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static int crc32c_by_table(const struct pkt &pkt)
+{
+    uint32_t crc = 0xffffffff;
+    crc = crc32c_bytes(crc, &pkt.seqnum, 4);
+    crc = crc32c_bytes(crc, &pkt.acknum, 4);
+    crc = crc32c_bytes(crc, pkt.payload, covered(pkt));
+    return (int) ~crc;
+}
+
+#ifdef HAVE_SSE42_CRC32C
+/* the payload in 8-byte words where the CPU has 64-bit crc32, then */
+/* 4-byte words, then single bytes                                  */
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32c_payload(uint32_t crc, const char *payload, int len)
+{
+    int i = 0;
+#ifdef __x86_64__
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, payload + i, 8);
+        crc = (uint32_t) _mm_crc32_u64(crc, w);
+    }
+#endif
+    for (; i + 4 <= len; i += 4) {
+        uint32_t w;
+        memcpy(&w, payload + i, 4);
+        crc = _mm_crc32_u32(crc, w);
+    }
+    for (; i < len; i++)
+        crc = _mm_crc32_u8(crc, (unsigned char) payload[i]);
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+static int crc32c_by_sse42(const struct pkt &pkt)
+{
+    uint32_t crc = 0xffffffff;
+    crc = _mm_crc32_u32(crc, (uint32_t) pkt.seqnum);
+    crc = _mm_crc32_u32(crc, (uint32_t) pkt.acknum);
+    crc = crc32c_payload(crc, pkt.payload, covered(pkt));
+    return (int) ~crc;
+}
+#endif
+
+typedef int (*checksum_fn)(const struct pkt &pkt);
+
+static checksum_fn select_crc32c()
+{
+#ifdef HAVE_SSE42_CRC32C
+    __builtin_cpu_init();   /* this runs before main() */
+    if (__builtin_cpu_supports("sse4.2"))
+        return crc32c_by_sse42;
+#endif
+    return crc32c_by_table;
+}
+
+static const checksum_fn crc32c = select_crc32c();
+
+const char *crc32c_implementation()
+{
+    return crc32c == crc32c_by_table ? "table" : "sse4.2";
+}
+
+int make_checksum(enum checksum_type type, const struct pkt &pkt)
+{
+    switch (type) {
+    case CHECKSUM_INET:
+        return inet_checksum(pkt);
+    case CHECKSUM_CRC32C:
+        return crc32c(pkt);
+    default:
+        return sum_checksum(pkt);
+    }
+}
@@ -0,0 +1,151 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "../include/congestion.h"
+
+void congestion_control::changed()
+{
+    cwnd = std::max(1.0, std::min(cwnd, (double) maxwin));
+    if (cwnd != recorded) {
+        recorded = cwnd;
+        sim_stat(sim, "cwnd", cwnd);
+        sim_sample(sim, AorB, "cwnd", cwnd);
+    }
+}
+
+/************************** FIXED ***************/
+/* The -w window, whatever happens: senders behave as they always did. */
+class fixed_window : public congestion_control {
+public:
+    fixed_window(struct simulation *sim, int AorB, int maxwin)
+            : congestion_control(sim, AorB, maxwin) {}
+
+    const char *name() const {
+        return "fixed";
+    }
+
+protected:
+    void on_ack(int n, simtime_t now) {}
+
+    void on_loss(simtime_t now) {}
+
+    void on_timeout(simtime_t now) {}
+};
+
+/************************** AIMD ***************/
+/* TCP Reno: one more packet per ACK below ssthresh (slow start), one */
+/* more per window of ACKs above it; a loss halves the window, a      */
+/* timeout restarts slow start from 1.                                */
+class aimd : public congestion_control {
+public:
+    aimd(struct simulation *sim, int AorB, int maxwin)
+            : congestion_control(sim, AorB, maxwin) {
+        start(1);
+    }
+
+    const char *name() const {
+        return "aimd";
+    }
+
+protected:
+    void on_ack(int n, simtime_t now) {
+        for (int i = 0; i < n; i++)
+            cwnd += cwnd < ssthresh ? 1 : 1 / cwnd;
+    }
+
+    void on_loss(simtime_t now) {
+        ssthresh = std::max(cwnd / 2, 2.0);
+        cwnd = ssthresh;
+    }
+
+    void on_timeout(simtime_t now) {
+        ssthresh = std::max(cwnd / 2, 2.0);
+        cwnd = 1;
+    }
+};
+
+/************************** CUBIC ***************/
+/* CUBIC (RFC 8312): after a loss the window follows                  */
+/*   W(t) = C (t - K)^3 + Wmax,  K = cbrt(Wmax (1 - beta) / C)         */
+/* from beta * Wmax, flattening out around the Wmax it last lost at    */
+/* before probing past it.  The RFC's constants are tuned for t in    */
+/* seconds on paths of ~100 ms; one-way delays here average 5.5 time  */
+/* units, so SECOND time units stand in for a second.                  */
+class cubic : public congestion_control {
+public:
+    cubic(struct simulation *sim, int AorB, int maxwin)
+            : congestion_control(sim, AorB, maxwin), wmax(0), lastmax(0), K(0), epoch(-1) {
+        start(1);
+    }
+
+    const char *name() const {
+        return "cubic";
+    }
+
+protected:
+    void on_ack(int n, simtime_t now) {
+        if (cwnd < ssthresh) {
+            cwnd += n;
+            return;
+        }
+        if (epoch < 0) {
+            /* first ACK of an epoch, e.g. slow start just ended */
+            epoch = now;
+            if (wmax < cwnd) {
+                wmax = cwnd;
+                K = 0;
+            } else {
+                K = cbrt((wmax - cwnd) / C);
+            }
+        }
+        double t = (now - epoch) / SECOND;
+        double target = C * (t - K) * (t - K) * (t - K) + wmax;
+        if (target > cwnd)
+            cwnd += n * (target - cwnd) / cwnd;
+        else
+            cwnd += n * 0.01 / cwnd;
+    }
+
+    void on_loss(simtime_t now) {
+        reduce();
+        cwnd = ssthresh;
+    }
+
+    void on_timeout(simtime_t now) {
+        reduce();
+        cwnd = 1;
+    }
+
+private:
+    static const double C, BETA, SECOND;
+
+    double wmax;        /* window at the last loss */
+    double lastmax;     /* wmax before that, for fast convergence */
+    double K;
+    simtime_t epoch;    /* start of the current growth epoch, -1 if none */
+
+    void reduce() {
+        /* fast convergence: losing below the last Wmax means another */
+        /* flow has taken bandwidth, so give up some more of it       */
+        wmax = cwnd < lastmax ? cwnd * (1 + BETA) / 2 : cwnd;
+        lastmax = cwnd;
+        ssthresh = std::max(cwnd * BETA, 2.0);
+        epoch = -1;
+    }
+};
+
+const double cubic::C = 0.4;
+const double cubic::BETA = 0.7;
+const double cubic::SECOND = 100;
+
+congestion_control *make_congestion_control(const char *name, struct simulation *sim, int AorB, int maxwin)
+{
+    if (strcmp(name, "fixed") == 0)
+        return new fixed_window(sim, AorB, maxwin);
+    if (strcmp(name, "aimd") == 0)
+        return new aimd(sim, AorB, maxwin);
+    if (strcmp(name, "cubic") == 0)
+        return new cubic(sim, AorB, maxwin);
+    return NULL;
+}
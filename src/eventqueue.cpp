@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "../include/eventqueue.h"
+
+/************************** SORTED LIST ***************/
+/* The original evlist: insertion walks the list from the front. */
+class list_queue : public event_queue {
+public:
+    list_queue() : head(NULL), count(0) {}
+
+    struct event *pop() {
+        struct event *p = head;
+        if (p == NULL)
+            return NULL;
+        head = p->next;
+        if (head != NULL)
+            head->prev = NULL;
+        count--;
+        return p;
+    }
+
+    void remove(struct event *q) {
+        if (q->next == NULL && q->prev == NULL)
+            head = NULL;             /* remove first and only event on list */
+        else if (q->next == NULL)    /* end of list - there is one in front */
+            q->prev->next = NULL;
+        else if (q == head) {        /* front of list - there must be event after */
+            q->next->prev = NULL;
+            head = q->next;
+        } else {                     /* middle of list */
+            q->next->prev = q->prev;
+            q->prev->next = q->next;
+        }
+        count--;
+    }
+
+    unsigned long size() const {
+        return count;
+    }
+
+    void collect(std::vector<struct event *> &out) const {
+        for (struct event *q = head; q != NULL; q = q->next)
+            out.push_back(q);
+    }
+
+    const char *name() const {
+        return "list";
+    }
+
+protected:
+    void push(struct event *p) {
+        struct event *q, *qold;
+
+        count++;
+        q = head;
+        if (q == NULL) {             /* list is empty */
+            head = p;
+            p->next = NULL;
+            p->prev = NULL;
+            return;
+        }
+        for (qold = q; q != NULL && p->evtime > q->evtime; q = q->next)
+            qold = q;
+        if (q == NULL) {             /* end of list */
+            qold->next = p;
+            p->prev = qold;
+            p->next = NULL;
+        } else if (q == head) {      /* front of list */
+            p->next = head;
+            p->prev = NULL;
+            p->next->prev = p;
+            head = p;
+        } else {                     /* middle of list */
+            p->next = q;
+            p->prev = q->prev;
+            q->prev->next = p;
+            q->prev = p;
+        }
+    }
+
+private:
+    struct event *head;
+    unsigned long count;
+};
+
+/************************** BINARY HEAP ***************/
+/* qindex tracks each event's slot so a cancelled timer can be removed */
+/* in O(log n) without searching.                                      */
+class heap_queue : public event_queue {
+public:
+    struct event *pop() {
+        if (heap.empty())
+            return NULL;
+        struct event *top = heap[0];
+        take(0);
+        return top;
+    }
+
+    void remove(struct event *e) {
+        take((unsigned long) e->qindex);
+    }
+
+    unsigned long size() const {
+        return heap.size();
+    }
+
+    void collect(std::vector<struct event *> &out) const {
+        out.insert(out.end(), heap.begin(), heap.end());
+    }
+
+    const char *name() const {
+        return "heap";
+    }
+
+protected:
+    void push(struct event *e) {
+        heap.push_back(e);
+        sift_up(heap.size() - 1);
+    }
+
+private:
+    std::vector<struct event *> heap;
+
+    void place(unsigned long i, struct event *e) {
+        heap[i] = e;
+        e->qindex = (int) i;
+    }
+
+    void take(unsigned long i) {
+        struct event *last = heap.back();
+        heap.pop_back();
+        if (i == heap.size())
+            return;
+        place(i, last);
+        if (i > 0 && event_before(last, heap[(i - 1) / 2]))
+            sift_up(i);
+        else
+            sift_down(i);
+    }
+
+    void sift_up(unsigned long i) {
+        struct event *e = heap[i];
+        while (i > 0) {
+            unsigned long parent = (i - 1) / 2;
+            if (!event_before(e, heap[parent]))
+                break;
+            place(i, heap[parent]);
+            i = parent;
+        }
+        place(i, e);
+    }
+
+    void sift_down(unsigned long i) {
+        struct event *e = heap[i];
+        unsigned long n = heap.size();
+        for (;;) {
+            unsigned long child = 2 * i + 1;
+            if (child >= n)
+                break;
+            if (child + 1 < n && event_before(heap[child + 1], heap[child]))
+                child++;
+            if (!event_before(heap[child], e))
+                break;
+            place(i, heap[child]);
+            i = child;
+        }
+        place(i, e);
+    }
+};
+
+/************************** CALENDAR QUEUE ***************/
+/* R. Brown, "Calendar queues", CACM 31(10), 1988.  Each bucket is a    */
+/* sorted list covering every nbuckets-th slice of width time units.   */
+/* Slices are numbered with vslice() everywhere, so an event is always */
+/* looked for in exactly the slice it was filed under.                 */
+class calendar_queue : public event_queue {
+public:
+    calendar_queue() : count(0), width(1.0), cur(0) {
+        buckets.resize(MIN_BUCKETS, (struct event *) NULL);
+    }
+
+    struct event *pop() {
+        if (count == 0)
+            return NULL;
+        unsigned long nb = buckets.size();
+        struct event *e = NULL;
+        for (unsigned long k = 0; k < nb; k++, cur++) {
+            struct event *h = buckets[cur % nb];
+            if (h != NULL && vslice(h->evtime) <= cur) {
+                e = h;
+                break;
+            }
+        }
+        if (e == NULL) {
+            /* nothing within a year: jump straight to the earliest event */
+            for (unsigned long i = 0; i < nb; i++)
+                if (buckets[i] != NULL && (e == NULL || event_before(buckets[i], e)))
+                    e = buckets[i];
+            cur = vslice(e->evtime);
+        }
+        unlink(e);
+        if (count < nb / 2 && nb > MIN_BUCKETS)
+            resize(nb / 2);
+        return e;
+    }
+
+    void remove(struct event *e) {
+        unlink(e);
+    }
+
+    unsigned long size() const {
+        return count;
+    }
+
+    void collect(std::vector<struct event *> &out) const {
+        for (unsigned long i = 0; i < buckets.size(); i++)
+            for (struct event *q = buckets[i]; q != NULL; q = q->next)
+                out.push_back(q);
+    }
+
+    const char *name() const {
+        return "calendar";
+    }
+
+protected:
+    void push(struct event *e) {
+        file(e);
+        if (count > 2 * buckets.size())
+            resize(2 * buckets.size());
+    }
+
+private:
+    enum { MIN_BUCKETS = 16, SAMPLE = 25 };
+
+    std::vector<struct event *> buckets;
+    unsigned long count;
+    double width;            /* time covered by one slice */
+    long long cur;           /* slice of the last dequeued event */
+
+    long long vslice(simtime_t t) const {
+        return (long long) std::floor(t / width);
+    }
+
+    void file(struct event *p) {
+        long long v = vslice(p->evtime);
+        if (v < cur)
+            cur = v;
+        unsigned long b = (unsigned long) (v % (long long) buckets.size());
+        struct event *q = buckets[b], *qold = NULL;
+        for (; q != NULL && event_before(q, p); q = q->next)
+            qold = q;
+        p->qindex = (int) b;
+        p->prev = qold;
+        p->next = q;
+        if (q != NULL)
+            q->prev = p;
+        if (qold != NULL)
+            qold->next = p;
+        else
+            buckets[b] = p;
+        count++;
+    }
+
+    void unlink(struct event *e) {
+        if (e->prev != NULL)
+            e->prev->next = e->next;
+        else
+            buckets[e->qindex] = e->next;
+        if (e->next != NULL)
+            e->next->prev = e->prev;
+        count--;
+    }
+
+    /* re-file every event into nb buckets, sizing a slice to about three */
+    /* times the mean gap between the earliest pending events             */
+    void resize(unsigned long nb) {
+        std::vector<struct event *> all;
+        all.reserve(count);
+        collect(all);
+
+        unsigned long n = std::min<unsigned long>((unsigned long) SAMPLE, all.size());
+        if (n > 1) {
+            std::partial_sort(all.begin(), all.begin() + n, all.end(), event_before);
+            double gap = (all[n - 1]->evtime - all[0]->evtime) / (n - 1);
+            if (gap > 0)
+                width = 3.0 * gap;
+        }
+
+        buckets.assign(nb, (struct event *) NULL);
+        count = 0;
+        cur = all.empty() ? 0 : vslice(all[0]->evtime);
+        for (unsigned long i = 0; i < all.size(); i++)
+            file(all[i]);
+    }
+};
+
+/************************** EVENT POOL ***************/
+/* Slab i holds FIRST_SLAB << i events, so growth takes O(log n) mallocs. */
+void event_pool::set_mtu(int mtu)
+{
+    size_t align = __alignof__(struct event);
+    size = offsetof(struct event, pkt) + pkt_storage(mtu);
+    size = std::min((size + align - 1) / align * align, sizeof(struct event));
+}
+
+void event_pool::grow()
+{
+    unsigned long n = (unsigned long) FIRST_SLAB << slabs.size();
+    char *slab = (char *) malloc(n * size);
+    if (slab == NULL) {
+        fprintf(stderr, "Out of memory for %lu events\n", n);
+        exit(-1);
+    }
+    slabs.push_back((struct event *) slab);
+    for (unsigned long i = n; i-- > 0;) {
+        struct event *e = (struct event *) (slab + i * size);
+        e->next = freelist;
+        freelist = e;
+    }
+}
+
+unsigned long event_pool::capacity() const
+{
+    return ((unsigned long) FIRST_SLAB << slabs.size()) - FIRST_SLAB;
+}
+
+event_pool::~event_pool()
+{
+    for (unsigned long i = 0; i < slabs.size(); i++)
+        free(slabs[i]);
+}
+
+event_queue *make_event_queue(const char *name)
+{
+    if (strcmp(name, "list") == 0)
+        return new list_queue();
+    if (strcmp(name, "heap") == 0)
+        return new heap_queue();
+    if (strcmp(name, "calendar") == 0)
+        return new calendar_queue();
+    return NULL;
+}
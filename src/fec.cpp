@@ -0,0 +1,95 @@
+#include <cstring>
+#include <algorithm>
+
+#include "../include/fec.h"
+
+fec::fec(struct simulation *sim, int AorB, int k, int m, enum checksum_type checksum)
+        : sim(sim), AorB(AorB), k(k), m(m), checksum(checksum), inblock(0), first(0), parities(m) {
+    recent.resize(2 * k, getmtu(sim));
+}
+
+void fec::sent(const struct pkt &packet) {
+    if (inblock == 0) {
+        first = packet.seqnum;
+        for (int j = 0; j < m; j++)
+            memset(&parities[j], 0, pkt_storage(PKT_HEADER + std::max(parities[j].length, (int) FEC_HEADER)));
+    }
+    struct pkt &p = parities[inblock % m];
+    p.acknum ^= packet.acknum;
+    p.msgid ^= packet.msgid;
+    p.payload[2] ^= (char) (packet.length & 0xff);
+    p.payload[3] ^= (char) (packet.length >> 8);
+    for (int i = 0; i < packet.length; i++)
+        p.payload[FEC_HEADER + i] ^= packet.payload[i];
+    p.length = std::max(p.length, FEC_HEADER + packet.length);
+    if (++inblock == k) {
+        send_parity();
+        inblock = 0;
+    }
+}
+
+void fec::send_parity() {
+    for (int j = 0; j < m; j++) {
+        struct pkt &p = parities[j];
+        p.seqnum = first;
+        p.payload[0] = (char) FEC_MARKER;
+        p.payload[1] = (char) j;
+        p.checksum = make_checksum(checksum, p);
+        tolayer3(sim, AorB, p);
+    }
+}
+
+/* an older packet, e.g. one resent, never displaces a newer one */
+void fec::received(const struct pkt &packet) {
+    struct slot &s = recent[packet.seqnum];
+    if (s.valid && !seq_before((seqnum_t) s.pkt.seqnum, (seqnum_t) packet.seqnum))
+        return;
+    s.valid = true;
+    copy_pkt(&s.pkt, packet);
+}
+
+const struct pkt *fec::stored(seqnum_t seq) const {
+    const struct slot &s = recent[seq];
+    return s.valid && (seqnum_t) s.pkt.seqnum == seq ? &s.pkt : NULL;
+}
+
+bool fec::recover(const struct pkt &parity, struct pkt *rebuilt) {
+    int j = (unsigned char) parity.payload[1];
+    seqnum_t missing = 0;
+    int nmissing = 0;
+    if (is_corrupt(checksum, parity) || j >= m)
+        return false;
+    for (int i = j; i < k; i += m)
+        if (stored(parity.seqnum + i) == NULL) {
+            missing = parity.seqnum + i;
+            nmissing++;
+        }
+    if (nmissing != 1)
+        return false;
+
+    int length = (unsigned char) parity.payload[2] | (unsigned char) parity.payload[3] << 8;
+    rebuilt->acknum = parity.acknum;
+    rebuilt->msgid = parity.msgid;
+    for (int i = j; i < k; i += m) {
+        const struct pkt *p = stored(parity.seqnum + i);
+        if (p != NULL) {
+            rebuilt->acknum ^= p->acknum;
+            rebuilt->msgid ^= p->msgid;
+            length ^= p->length;
+        }
+    }
+    if (length > parity.length - FEC_HEADER)
+        return false;
+    rebuilt->seqnum = missing;
+    rebuilt->length = length;
+    memcpy(rebuilt->payload, parity.payload + FEC_HEADER, length);
+    for (int i = j; i < k; i += m) {
+        const struct pkt *p = stored(parity.seqnum + i);
+        if (p != NULL)
+            for (int b = 0, n = std::min(p->length, length); b < n; b++)
+                rebuilt->payload[b] ^= p->payload[b];
+    }
+    rebuilt->checksum = make_checksum(checksum, *rebuilt);
+    sim_stat(sim, "fec_recovered", 1);
+    return true;
+}
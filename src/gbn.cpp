@@ -1,10 +1,18 @@
 #include "../include/simulator.h"
+#include "../include/window.h"
+#include "../include/congestion.h"
+#include "../include/checksum.h"
+#include "../include/coalesce.h"
+#include "../include/fec.h"
+#include "../include/transport.h"
 #include <iostream>
 #include <cstring>
 #include <vector>
-#include <queue>
 #include <iomanip>
 #include <cmath>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
 
 /* ******************************************************************
  ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
@@ -21,193 +29,787 @@
 
 /********* STUDENTS WRITE THE NEXT SEVEN ROUTINES *********/
 
-#define DEBUG_LOG(AorB, str) do { std::cout << std::setprecision(5) << std::setw(8) << get_sim_time() << "T: " << std::setw(3) << __LINE__  << "L: " << AorB << " : " << str << std::endl; } while( false )
+#define DEBUG_LOG(AorB, str) do { if (gettrace(sim) > 0) std::cout << std::setprecision(5) << std::setw(8) << get_sim_time(sim) << "T: " << std::setw(3) << __LINE__  << "L: " << (AorB) << " : " << str << std::endl; } while( false )
 #define DEBUG_A(str) DEBUG_LOG('A', str)
 #define DEBUG_B(str) DEBUG_LOG('B', str)
+#define DEBUG_SIDE(AorB, str) DEBUG_LOG((AorB) ? 'B' : 'A', str)
 
-std::ostream &operator<<(std::ostream &, const pkt &);
+static std::ostream &operator<<(std::ostream &, const pkt &);
 
-std::ostream &operator<<(std::ostream &, const msg &);
+static std::ostream &operator<<(std::ostream &, const msg &);
 
-pkt make_pkt(int seq, int ack, const struct msg *msg);
+static void make_pkt(struct pkt *pkt, int seq, int ack, const struct msg *msg, enum checksum_type checksum);
 
-pkt make_ack(int ack);
+static void make_ack(struct pkt *pkt, int ack, int rwnd, enum checksum_type checksum);
 
-int make_checksum(const struct pkt &pkt);
+static int get_rwnd(const struct pkt &pkt);
 
-bool is_corrupt(const struct pkt &pkt);
-
-static float initial_rtt = 10.0f,
-        alpha = 0.125f,
-        beta = 0.25f,
-        SampleRTT = initial_rtt,
-        EstimatedRTT = initial_rtt,
-        DevRTT = 0.0f;
-
-float TimeoutInterval();
+static bool has_data(const struct pkt &pkt);
 
 // A
 struct buffer {
-    struct pkt pkt;
     bool retransmitted;
-    float sent_time;
+    simtime_t sent_time;
+    int delivered;              /* the sender's delivered and     */
+    simtime_t delivered_time;   /* delivered_time when it was sent */
+    struct pkt pkt;             /* last, see packet_window */
+};
+
+class gbn : public protocol {
+public:
+    explicit gbn(struct simulation *sim);
+
+    ~gbn();
+
+    void A_send(const struct msg &message);
+
+    void A_receive(const struct pkt &packet);
+
+    void A_timerinterrupt();
+
+    void A_timerinterrupt_id(int id);
+
+    void A_init();
+
+    void B_receive(const struct pkt &packet);
+
+    void B_init();
+
+    void B_send(const struct msg &message);
+
+    void B_timerinterrupt();
+
+    void B_timerinterrupt_id(int id);
+
+private:
+    simtime_t initial_rtt;
+    float alpha,
+            beta;
+
+    /* Go-back episodes last until recover, the last packet outstanding */
+    /* when they began, is ACKed.  Duplicates of a timed-out window     */
+    /* draw duplicate ACKs, so only a fast retransmit may follow one.   */
+    enum recovery { OPEN, FAST, TIMEOUT };
+
+    /* Each entity runs a sender for its own data and a receiver for the */
+    /* other's.  Data packets carry the receiver's cumulative ACK, so in  */
+    /* bidirectional runs an ACK only goes out alone when no data leaves  */
+    /* in the same input event.                                            */
+    struct entity {
+        simtime_t SampleRTT,
+                EstimatedRTT,
+                DevRTT;
+
+        // sender
+        packet_window<struct buffer> sndpkt;
+        message_queue buffer;
+        seqnum_t base, nextseqnum;
+        int N;
+        congestion_control *cc;
+        int rwnd;           /* window the other side advertised last */
+        seqnum_t resend;    /* [resend, nextseqnum) still to go back over */
+        int dupacks;        /* pure ACKs repeating base - 1 */
+        enum recovery recovering;
+        seqnum_t recover;
+        int delivered;      /* packets ACKed so far */
+        simtime_t delivered_time;   /* when the last of them was */
+        float bw;           /* delivery rate, the largest recent sample */
+        simtime_t bw_time;  /* when bw was sampled */
+        bool pacetimer;     /* PACE_TIMER is running */
+        bool coalescetimer; /* COALESCE_TIMER is running */
+        bool flush;         /* queued messages have waited coalescedelay */
+        fec *coder;         /* the option fec, or NULL */
+
+        // receiver
+        seqnum_t expectedseqnum;
+        bool ack_pending;
+        int unacked;        /* packets taken since the last ACK went out */
+        bool acktimer;      /* ACK_TIMER is running */
+        message_queue unread;     /* delivered, not yet read by layer 5 */
+        int advertised;     /* the window in the last ACK */
+    } side[2];
+
+    /* the options shared with sr, see transport.h */
+    struct transport_options options;
+
+    /* Pacing, from the option pace=b (b packets at a time, 1 if no     */
+    /* value; 0, the default, sends whatever the window allows at once). */
+    /* Sends and resends leave in batches of b at pace_gain times the    */
+    /* delivery rate: packets ACKed between sending a packet and its ACK, */
+    /* over that time, the largest sample of the last 10 RTTs.  The gain */
+    /* probes for more; the medium limits what comes back.  A go-back    */
+    /* then no longer queues the whole window in the medium at once,     */
+    /* behind which every new packet would have to wait.                 */
+    int pacebatch;
+    float pace_gain;
+
+    enum { ACK_TIMER = 0, READ_TIMER = 1, PACE_TIMER = 2, COALESCE_TIMER = 3 };   /* numbered timers */
+
+    simtime_t TimeoutInterval(int AorB);
+
+    void output(int AorB, const struct msg &message);
+
+    void input(int AorB, const struct pkt &packet);
+
+    void parity(int AorB, const struct pkt &packet);
+
+    void timerinterrupt(int AorB);
+
+    void fast_retransmit(int AorB);
+
+    void go_back(int AorB, const char *why);
+
+    void resend_window(int AorB, const char *why);
+
+    /* packets that may be outstanding: -w, or less under the cc option */
+    /* or the other side's advertised window                            */
+    int window(int AorB) const {
+        const entity &e = side[AorB];
+        return std::max(1, std::min(std::min(e.N, e.cc->window()), e.rwnd));
+    }
+
+    int rcvwindow(int AorB) const {
+        return std::max(0, options.rcvbuffer - (int) side[AorB].unread.size());
+    }
+
+    void deliver(int AorB, const char *payload, int length, msgid_t msgid);
+
+    void deliver_packet(int AorB, const struct pkt &packet);
+
+    void read(int AorB);
+
+    void backpressure(int AorB);
+
+    void timerinterrupt_id(int AorB, int id);
+
+    void send(int AorB, const struct msg &message);
+
+    bool send_coalesced(int AorB);
+
+    void send_packet(int AorB);
+
+    void send_buffered(int AorB);
+
+    void pace(int AorB);
+
+    simtime_t pace_gap(int AorB);
+
+    void sample_rate(int AorB, const struct buffer &b);
+
+    bool send_next(int AorB);
+
+    void send_ack(int AorB);
+
+    void init(int AorB);
 };
-static std::vector<buffer> sndpkt(1100);
-static std::queue<msg> buffer;
-static int base = 1, nextseqnum = 1, N;
 
-void send_buffered();
+gbn::gbn(struct simulation *sim)
+        : protocol(sim),
+          initial_rtt(10.0f), alpha(0.125f), beta(0.25f),
+          options(), pacebatch(0), pace_gain(1.25f) {
+    for (int i = 0; i < 2; i++) {
+        entity &e = side[i];
+        e.SampleRTT = e.EstimatedRTT = initial_rtt;
+        e.DevRTT = 0.0f;
+        e.base = e.nextseqnum = 1;
+        e.N = 0;
+        e.cc = NULL;
+        e.rwnd = INT_MAX;
+        e.resend = e.nextseqnum;
+        e.dupacks = 0;
+        e.recovering = OPEN;
+        e.recover = 0;
+        e.delivered = 0;
+        e.delivered_time = 0;
+        e.bw = 0;
+        e.bw_time = 0;
+        e.pacetimer = false;
+        e.coalescetimer = false;
+        e.flush = false;
+        e.coder = NULL;
+        e.expectedseqnum = 1;
+        e.ack_pending = false;
+        e.unacked = 0;
+        e.acktimer = false;
+        e.advertised = INT_MAX;
+    }
+}
 
-// B
-static volatile int expectedseqnum = 1;
+gbn::~gbn() {
+    delete side[0].cc;
+    delete side[1].cc;
+    delete side[0].coder;
+    delete side[1].coder;
+}
 
 /* called from layer 5, passed the data to be sent to other side */
-void A_output(struct msg message) {
-    if (nextseqnum < base + N) {
-        struct buffer b = {make_pkt(nextseqnum, 0, &message), false, get_sim_time()};
-        sndpkt[nextseqnum] = b;
-        tolayer3(0, sndpkt[nextseqnum].pkt);
-        if (base == nextseqnum) {
-            starttimer(0, TimeoutInterval());
-        }
-        nextseqnum++;
-        DEBUG_A("Sent: " << message);
+void gbn::A_send(const struct msg &message) {
+    output(0, message);
+}
+
+void gbn::B_send(const struct msg &message) {
+    output(1, message);
+}
+
+void gbn::output(int AorB, const struct msg &message) {
+    entity &e = side[AorB];
+    if (pacebatch > 0) {
+        e.buffer.push(message);
+        DEBUG_SIDE(AorB, "Buffered: " << message);
+        pace(AorB);
+        return;
+    }
+    if (options.coalescing) {
+        e.buffer.push(message);
+        DEBUG_SIDE(AorB, "Buffered: " << message);
+        send_buffered(AorB);
+        return;
+    }
+    /* behind messages already waiting, it waits too, so layer 5's */
+    /* messages leave in the order they came                        */
+    if (e.buffer.empty() && seq_before(e.nextseqnum, e.base + window(AorB))) {
+        send(AorB, message);
+        DEBUG_SIDE(AorB, "Sent: " << message);
     } else {
-        buffer.push(message);
-        DEBUG_A("Buffered: " << message);
+        e.buffer.push(message);
+        DEBUG_SIDE(AorB, "Buffered: " << message);
     }
+    backpressure(AorB);
 }
 
-/* called from layer 3, when a packet arrives for layer 4 */
-void A_input(struct pkt packet) {
-    if (!is_corrupt(packet)) {
-        if (packet.acknum < base) {
-            DEBUG_A("\033[31;1m" << "Receive ACK: " << packet.acknum << " is less than BASE: " << base << " ignoring" <<
-                    "\033[0m");
-            return;
+/* layer 5 may hand over another message while the window has room or */
+/* fewer than sendbuffer wait for it; paced, every message waits       */
+void gbn::backpressure(int AorB) {
+    entity &e = side[AorB];
+    bool full = (pacebatch > 0 || !seq_before(e.nextseqnum, e.base + window(AorB)))
+                && (int) e.buffer.size() >= options.sendbuffer;
+    setbackpressure(sim, AorB, full);
+}
+
+/* send message as packet nextseqnum */
+void gbn::send(int AorB, const struct msg &message) {
+    entity &e = side[AorB];
+    make_pkt(&e.sndpkt[e.nextseqnum].pkt, e.nextseqnum, e.expectedseqnum - 1, &message, options.checksum);
+    send_packet(AorB);
+}
+
+/* send as many queued messages as fit as packet nextseqnum, unless */
+/* they leave it short and may still wait for more                  */
+bool gbn::send_coalesced(int AorB) {
+    entity &e = side[AorB];
+    /* with fec, leave room for the parity packet's own header */
+    int room = getmtu(sim) - PKT_HEADER - (e.coder != NULL ? FEC_HEADER : 0);
+    int n = coalescible(e.buffer, room);   /* at least 1, see init() */
+    bool full = (unsigned long) n < e.buffer.size() || n == COALESCE_MAX;
+    if (!full && !e.flush && options.coalescedelay > 0) {
+        if (!e.coalescetimer) {
+            starttimer_id(sim, AorB, COALESCE_TIMER, options.coalescedelay);
+            e.coalescetimer = true;
         }
-        DEBUG_A("\033[1;1m" << "Receive ACK: " << sndpkt[packet.acknum].pkt << "\033[0m");
+        return false;
+    }
+    struct pkt &p = e.sndpkt[e.nextseqnum].pkt;
+    p.seqnum = e.nextseqnum;
+    p.acknum = e.expectedseqnum - 1;
+    p.length = coalesce(e.buffer, n, &p);
+    p.checksum = make_checksum(options.checksum, p);
+    DEBUG_SIDE(AorB, "Sent " << n << " coalesced: " << p);
+    sim_stat(sim, "coalesced", n);
+    if (e.buffer.empty()) {
+        e.flush = false;
+        if (e.coalescetimer) {
+            stoptimer_id(sim, AorB, COALESCE_TIMER);
+            e.coalescetimer = false;
+        }
+    }
+    send_packet(AorB);
+    return true;
+}
+
+/* send packet nextseqnum, just filled in, carrying the current ACK */
+void gbn::send_packet(int AorB) {
+    entity &e = side[AorB];
+    if (e.base == e.nextseqnum)
+        e.delivered_time = get_sim_time(sim);   /* not idle time */
+    struct buffer &b = e.sndpkt[e.nextseqnum];
+    b.retransmitted = false;
+    b.sent_time = get_sim_time(sim);
+    b.delivered = e.delivered;
+    b.delivered_time = e.delivered_time;
+    tolayer3(sim, AorB, b.pkt);
+    if (e.coder != NULL)
+        e.coder->sent(b.pkt);
+    if (e.ack_pending) {
+        e.ack_pending = false;
+        e.unacked = 0;
+        if (e.acktimer) {
+            stoptimer_id(sim, AorB, ACK_TIMER);
+            e.acktimer = false;
+        }
+    }
+    if (e.base == e.nextseqnum) {
+        starttimer(sim, AorB, TimeoutInterval(AorB));
+    }
+    e.nextseqnum++;
+    e.resend = e.nextseqnum;
+}
 
-        if (!sndpkt[packet.acknum].retransmitted) {
-            SampleRTT = get_sim_time() - sndpkt[packet.acknum].sent_time;
-            EstimatedRTT = ((1 - alpha) * EstimatedRTT + (alpha * SampleRTT));
-            DevRTT = ((1 - beta) * DevRTT + (beta * fabsf(SampleRTT - EstimatedRTT)));
+/* called from layer 3, when a packet arrives for layer 4 */
+void gbn::A_receive(const struct pkt &packet) {
+    input(0, packet);
+}
+
+/* Note that with simplex transfer from a-to-B, there is no B_send() */
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void gbn::B_receive(const struct pkt &packet) {
+    input(1, packet);
+}
+
+/* In simplex runs A only takes ACKs and B only takes data, as before. */
+void gbn::input(int AorB, const struct pkt &packet) {
+    entity &e = side[AorB];
+    bool bidirectional = getbidirectional(sim);
+    if (e.coder != NULL && fec::is_parity(packet)) {
+        parity(AorB, packet);
+        return;
+    }
+    bool corrupt = is_corrupt(options.checksum, packet);
+    bool ack_now = false;
+    if (e.coder != NULL && !corrupt && has_data(packet))
+        e.coder->received(packet);
+
+    // receiver: packets with a payload, and corrupt ones, are answered
+    if ((AorB == 1 || bidirectional) && (corrupt || has_data(packet))) {
+        if (!corrupt && (seqnum_t) packet.seqnum == e.expectedseqnum && rcvwindow(AorB) > 0) {
+            DEBUG_SIDE(AorB, "\033[32;1m" << "Received: " << packet << "\033[0m");
+            deliver_packet(AorB, packet);
+            e.expectedseqnum++;
+        } else {
+            DEBUG_SIDE(AorB, "Re-sending ACK: " << e.expectedseqnum - 1);
+            ack_now = options.ackoutoforder;
         }
+        e.ack_pending = true;
+        e.unacked++;
+    }
 
-        base = packet.acknum + 1;
-        if (base == nextseqnum) {
-            stoptimer(0);
-            send_buffered();
+    // sender
+    if (AorB == 0 || bidirectional) {
+        if (!corrupt) {
+            seqnum_t acknum = packet.acknum;
+            bool opened = false;    /* the advertised window grew */
+            if (!has_data(packet)) {
+                opened = get_rwnd(packet) > e.rwnd;
+                e.rwnd = get_rwnd(packet);
+            }
+            bool moved = seq_between(e.base, acknum, e.nextseqnum);
+            if (moved) {
+                DEBUG_SIDE(AorB, "\033[1;1m" << "Receive ACK: " << e.sndpkt[acknum].pkt << "\033[0m");
+
+                if (!e.sndpkt[acknum].retransmitted) {
+                    e.SampleRTT = get_sim_time(sim) - e.sndpkt[acknum].sent_time;
+                    e.EstimatedRTT = ((1 - alpha) * e.EstimatedRTT + (alpha * e.SampleRTT));
+                    e.DevRTT = ((1 - beta) * e.DevRTT + (beta * fabs(e.SampleRTT - e.EstimatedRTT)));
+                    sim_stat(sim, "rtt_sample", e.SampleRTT);
+                }
+
+                e.delivered += acknum - e.base + 1;
+                e.delivered_time = get_sim_time(sim);
+                sample_rate(AorB, e.sndpkt[acknum]);
+                e.cc->acked(acknum - e.base + 1);
+                e.base = acknum + 1;
+                e.dupacks = 0;
+                if (e.recovering != OPEN && !seq_before(acknum, e.recover)) {
+                    e.recovering = OPEN;
+                }
+                stoptimer(sim, AorB);
+                if (e.base != e.nextseqnum) {
+                    starttimer(sim, AorB, TimeoutInterval(AorB));
+                    DEBUG_SIDE(AorB, "\033[1;1m" << "Timer restart" << "\033[0m");
+                    resend_window(AorB, "RESENT: ");
+                }
+            } else if (options.dupthresh > 0 && !has_data(packet) && acknum == e.base - 1
+                       && e.base != e.nextseqnum) {
+                DEBUG_SIDE(AorB, "Receive DUP-ACK: " << acknum);
+                if (++e.dupacks == options.dupthresh
+                    && (e.recovering == OPEN || (e.recovering == FAST && options.fastrecovery))) {
+                    fast_retransmit(AorB);
+                }
+            } else {
+                DEBUG_SIDE(AorB, "\033[31;1m" << "Receive ACK: " << acknum << " is outside BASE: " << e.base <<
+                           " to " << e.nextseqnum << " ignoring" << "\033[0m");
+            }
+            /* waiting messages go once the window moves, or the other */
+            /* side opens it                                           */
+            if (moved || (opened && !e.buffer.empty()))
+                send_buffered(AorB);
         } else {
-            stoptimer(0);
-            starttimer(0, TimeoutInterval());
-            DEBUG_A("\033[1;1m" << "Timer restart" << "\033[0m");
+            DEBUG_SIDE(AorB, "Receive CORRUPT ACK: " << packet);
+        }
+    }
+
+    if (e.ack_pending) {
+        if (ack_now || e.unacked >= options.ackevery) {
+            send_ack(AorB);
+        } else if (options.ackdelay > 0 && !e.acktimer) {
+            starttimer_id(sim, AorB, ACK_TIMER, options.ackdelay);
+            e.acktimer = true;
         }
-    } else {
-        DEBUG_A("Receive CORRUPT ACK: " << packet);
     }
 }
 
-void send_buffered() {
-    while (!buffer.empty() && nextseqnum < base + N) {
-        struct msg message = buffer.front();
-        struct buffer b = {make_pkt(nextseqnum, 0, &message), false, get_sim_time()};
-        sndpkt[nextseqnum] = b;
-        tolayer3(0, sndpkt[nextseqnum].pkt);
-        if (base == nextseqnum) {
-            starttimer(0, TimeoutInterval());
+/* Takes the packet a parity packet rebuilds, then those that arrived */
+/* past it intact, which go-back-N dropped.                           */
+void gbn::parity(int AorB, const struct pkt &packet) {
+    entity &e = side[AorB];
+    struct pkt rebuilt;
+    if (!e.coder->recover(packet, &rebuilt)) {
+        DEBUG_SIDE(AorB, "Parity, nothing to recover: " << packet.seqnum);
+        return;
+    }
+    DEBUG_SIDE(AorB, "\033[32;1m" << "Recovered: " << rebuilt << "\033[0m");
+    input(AorB, rebuilt);
+    const struct pkt *next;
+    while ((next = e.coder->stored(e.expectedseqnum)) != NULL) {
+        seqnum_t expected = e.expectedseqnum;
+        input(AorB, *next);
+        if (e.expectedseqnum == expected)
+            break;
+    }
+}
+
+/* a pure cumulative ACK for everything taken so far */
+void gbn::send_ack(int AorB) {
+    entity &e = side[AorB];
+    e.advertised = rcvwindow(AorB);
+    struct pkt *ack = newpacket(sim);
+    make_ack(ack, e.expectedseqnum - 1, e.advertised, options.checksum);
+    DEBUG_SIDE(AorB, "Sending ACK: " << *ack);
+    sendpacket(sim, AorB, ack);
+    sim_stat(sim, "ack", e.unacked);
+    e.ack_pending = false;
+    e.unacked = 0;
+    if (e.acktimer) {
+        stoptimer_id(sim, AorB, ACK_TIMER);
+        e.acktimer = false;
+    }
+}
+
+void gbn::send_buffered(int AorB) {
+    entity &e = side[AorB];
+    if (pacebatch > 0) {
+        pace(AorB);
+        return;
+    }
+    while (!e.buffer.empty() && seq_before(e.nextseqnum, e.base + window(AorB))) {
+        if (options.coalescing) {
+            if (!send_coalesced(AorB))
+                break;
+            continue;
         }
-        nextseqnum++;
-        buffer.pop();
-        DEBUG_A("Sent buffered: " << message);
+        send(AorB, e.buffer.front());
+        DEBUG_SIDE(AorB, "Sent buffered: " << e.buffer.front());
+        e.buffer.pop();
     }
+    backpressure(AorB);
 }
 
-/* called when A's timer goes off */
-void A_timerinterrupt() {
-    starttimer(0, TimeoutInterval() * 2);
-    for (int i = base; (i < nextseqnum); ++i) {
-        tolayer3(0, sndpkt[i].pkt);
-        sndpkt[i].retransmitted = true;
-        DEBUG_A("\033[31;1m" << "TIMEOUT RESENT: " << sndpkt[i].pkt << "\033[0m");
+/* send the next batch, unless the last one is still being paced */
+void gbn::pace(int AorB) {
+    entity &e = side[AorB];
+    if (e.pacetimer)
+        return;
+    int sent = 0;
+    while (sent < pacebatch && send_next(AorB))
+        sent++;
+    if (sent > 0) {
+        simtime_t gap = pace_gap(AorB) * sent;
+        sim_stat(sim, "pace_gap", gap);
+        starttimer_id(sim, AorB, PACE_TIMER, gap);
+        e.pacetimer = true;
     }
+    backpressure(AorB);
 }
 
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init() {
-    N = getwinsize();
+/* time per packet; until there is a rate sample, a window per RTT */
+simtime_t gbn::pace_gap(int AorB) {
+    entity &e = side[AorB];
+    if (e.bw <= 0)
+        return e.EstimatedRTT / window(AorB);
+    return 1 / (pace_gain * e.bw);
 }
 
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
+/* b, just ACKed, gives a delivery rate sample */
+void gbn::sample_rate(int AorB, const struct buffer &b) {
+    entity &e = side[AorB];
+    simtime_t now = get_sim_time(sim);
+    if (now <= b.delivered_time)
+        return;
+    float rate = (e.delivered - b.delivered) / (now - b.delivered_time);
+    if (rate >= e.bw) {
+        e.bw = rate;
+        e.bw_time = now;
+    } else if (now - e.bw_time > 10 * e.EstimatedRTT) {
+        /* stale: come down, but not all the way to a sample taken */
+        /* across a timeout                                        */
+        e.bw = std::max(rate, e.bw / 2);
+        e.bw_time = now;
+    }
+}
 
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet) {
-    if (!is_corrupt(packet) && packet.seqnum == expectedseqnum) {
-        DEBUG_B("\033[32;1m" << "Received: " << packet << "\033[0m");
-        tolayer5(1, packet.payload);
+/* one packet that the window allows: what is left of a go-back first, */
+/* then a new message                                                  */
+bool gbn::send_next(int AorB) {
+    entity &e = side[AorB];
+    if (seq_before(e.resend, e.base))
+        e.resend = e.base;
+    if (!seq_before(e.resend, e.base + window(AorB)))
+        return false;
+    if (e.resend != e.nextseqnum) {
+        tolayer3(sim, AorB, e.sndpkt[e.resend].pkt);
+        e.sndpkt[e.resend].retransmitted = true;
+        e.sndpkt[e.resend].delivered = e.delivered;
+        e.sndpkt[e.resend].delivered_time = e.delivered_time;
+        DEBUG_SIDE(AorB, "\033[31;1m" << "PACED RESENT: " << e.sndpkt[e.resend].pkt << "\033[0m");
+        ++e.resend;
+        return true;
+    }
+    if (e.buffer.empty())
+        return false;
+    if (options.coalescing)
+        return send_coalesced(AorB);
+    send(AorB, e.buffer.front());
+    DEBUG_SIDE(AorB, "Sent: " << e.buffer.front());
+    e.buffer.pop();
+    return true;
+}
 
-        struct pkt ack = make_ack(expectedseqnum);
-        DEBUG_B("Sending ACK: " << ack);
-        tolayer3(1, ack);
+/* in-order data for layer 5, read at once or, with readdelay, queued */
+/* for the reader                                                     */
+void gbn::deliver(int AorB, const char *payload, int length, msgid_t msgid) {
+    entity &e = side[AorB];
+    if (options.readdelay <= 0) {
+        tolayer5(sim, AorB, payload, length, msgid);
+        return;
+    }
+    struct msg message;
+    message.length = length;
+    message.msgid = msgid;
+    memcpy(message.data, payload, length);
+    e.unread.push(message);
+    if (e.unread.size() == 1)
+        starttimer_id(sim, AorB, READ_TIMER, options.readdelay);
+}
 
-        expectedseqnum++;
-    } else {
-        DEBUG_B("Re-sending ACK: " << expectedseqnum - 1);
-        struct pkt ack = make_ack(expectedseqnum - 1);
-        tolayer3(1, ack);
+/* each message of an in-order packet */
+void gbn::deliver_packet(int AorB, const struct pkt &packet) {
+    if (!options.coalescing) {
+        deliver(AorB, packet.payload, packet.length, packet.msgid);
+        return;
+    }
+    coalesced_messages messages(packet);
+    const char *data;
+    int length;
+    msgid_t msgid;
+    while (messages.next(&data, &length, &msgid))
+        deliver(AorB, data, length, msgid);
+}
+
+/* layer 5 reads one message; a window that had closed is reopened */
+/* with an ACK at once                                            */
+void gbn::read(int AorB) {
+    entity &e = side[AorB];
+    tolayer5(sim, AorB, e.unread.front().data, e.unread.front().length, e.unread.front().msgid);
+    e.unread.pop();
+    if (!e.unread.empty())
+        starttimer_id(sim, AorB, READ_TIMER, options.readdelay);
+    if (e.advertised == 0) {
+        DEBUG_SIDE(AorB, "Window update: " << rcvwindow(AorB));
+        send_ack(AorB);
+    }
+}
+
+/* called when A's timer goes off */
+void gbn::A_timerinterrupt() {
+    timerinterrupt(0);
+}
+
+void gbn::B_timerinterrupt() {
+    timerinterrupt(1);
+}
+
+void gbn::A_timerinterrupt_id(int id) {
+    timerinterrupt_id(0, id);
+}
+
+void gbn::B_timerinterrupt_id(int id) {
+    timerinterrupt_id(1, id);
+}
+
+/* the ACK delay of the entity's receiver ran out, its reader is due, */
+/* the pacer may send again, or queued messages have waited long      */
+/* enough for others to coalesce with                                 */
+void gbn::timerinterrupt_id(int AorB, int id) {
+    if (id == READ_TIMER) {
+        read(AorB);
+        return;
+    }
+    if (id == PACE_TIMER) {
+        side[AorB].pacetimer = false;
+        pace(AorB);
+        return;
+    }
+    if (id == COALESCE_TIMER) {
+        side[AorB].coalescetimer = false;
+        side[AorB].flush = true;
+        send_buffered(AorB);
+        return;
     }
+    side[AorB].acktimer = false;
+    send_ack(AorB);
+}
+
+void gbn::timerinterrupt(int AorB) {
+    entity &e = side[AorB];
+    sim_stat(sim, "timeout", e.nextseqnum - e.base);
+    e.dupacks = 0;
+    e.recovering = TIMEOUT;
+    e.recover = e.nextseqnum - 1;
+    e.cc->timeout();
+    starttimer(sim, AorB, TimeoutInterval(AorB) * 2);
+    go_back(AorB, "TIMEOUT RESENT: ");
+}
+
+/* Duplicate ACKs mean base was lost and the receiver discards what    */
+/* followed it: go back now rather than at the timeout, with the timer */
+/* restarted but not backed off.                                       */
+void gbn::fast_retransmit(int AorB) {
+    entity &e = side[AorB];
+    sim_stat(sim, "fast_retransmit", e.nextseqnum - e.base);
+    if (e.recovering == OPEN)
+        e.cc->lost();
+    e.recovering = FAST;
+    e.recover = e.nextseqnum - 1;
+    stoptimer(sim, AorB);
+    starttimer(sim, AorB, TimeoutInterval(AorB));
+    go_back(AorB, "FAST RESENT: ");
+}
+
+void gbn::go_back(int AorB, const char *why) {
+    side[AorB].resend = side[AorB].base;
+    resend_window(AorB, why);
+}
+
+/* resend what the window allows of the last go-back; a congestion */
+/* window smaller than the go-back leaves the rest for later ACKs  */
+void gbn::resend_window(int AorB, const char *why) {
+    entity &e = side[AorB];
+    if (pacebatch > 0) {
+        pace(AorB);
+        return;
+    }
+    if (seq_before(e.resend, e.base))
+        e.resend = e.base;
+    for (; e.resend != e.nextseqnum && seq_before(e.resend, e.base + window(AorB)); ++e.resend) {
+        tolayer3(sim, AorB, e.sndpkt[e.resend].pkt);
+        e.sndpkt[e.resend].retransmitted = true;
+        e.sndpkt[e.resend].delivered = e.delivered;
+        e.sndpkt[e.resend].delivered_time = e.delivered_time;
+        DEBUG_SIDE(AorB, "\033[31;1m" << why << e.sndpkt[e.resend].pkt << "\033[0m");
+    }
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+void gbn::A_init() {
+    init(0);
 }
 
 /* the following rouytine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init() {
+void gbn::B_init() {
+    init(1);
+}
+
+void gbn::init(int AorB) {
+    entity &e = side[AorB];
+    if (!get_transport_options(sim, &options))
+        return;
+    e.N = getwinsize(sim);
+    e.sndpkt.resize(e.N, getmtu(sim));
+    pacebatch = (int) getoption(sim, "pace", getoption(sim, "pace") != NULL ? 1 : 0);
+    e.cc = make_congestion_control(options.cc, sim, AorB, e.N);
+    if (e.cc == NULL) {
+        sim_error(sim, "Unknown congestion control: %s", options.cc);
+        return;
+    }
+    if (!transport_fits_mtu(sim, options, getmaxmsgsize(sim)))
+        return;
+    if (options.feck > 0)
+        e.coder = new fec(sim, AorB, options.feck, options.fecm, options.checksum);
 }
 
 
-float TimeoutInterval() {
-    float TimeoutInterval = EstimatedRTT + 4 * DevRTT;
-    DEBUG_A("Estimated TimeoutInterval: " << TimeoutInterval);
+simtime_t gbn::TimeoutInterval(int AorB) {
+    simtime_t TimeoutInterval = side[AorB].EstimatedRTT + 4 * side[AorB].DevRTT;
+    DEBUG_SIDE(AorB, "Estimated TimeoutInterval: " << TimeoutInterval);
+    sim_stat(sim, "rto", TimeoutInterval);
     return TimeoutInterval;
 }
 
-pkt make_pkt(int seq, int ack, const struct msg *msg) {
-    struct pkt pkt = {seq, ack};
+/* packets are filled in where they lie: in the window, or in the */
+/* event that carries them (see newpacket())                        */
+static void make_pkt(struct pkt *pkt, int seq, int ack, const struct msg *msg, enum checksum_type checksum) {
+    pkt->seqnum = seq;
+    pkt->acknum = ack;
     if (msg != NULL) {
-        memcpy(pkt.payload, (*msg).data, 20);
+        pkt->length = (*msg).length;
+        pkt->msgid = (*msg).msgid;
+        memcpy(pkt->payload, (*msg).data, pkt->length);
+    } else {
+        pkt->length = 1;
+        pkt->payload[0] = '\0';
     }
-    pkt.checksum = make_checksum(pkt);
-    return pkt;
+    pkt->checksum = make_checksum(checksum, *pkt);
 }
 
-int make_checksum(const struct pkt &pkt) {
-    int checksum = 0;
-    checksum += pkt.seqnum;
-    checksum += pkt.acknum;
-    for (int i = 0; i < 20; ++i) {
-        checksum += pkt.payload[i];
-    }
-    return checksum;
+/* the advertised window travels in payload[1..2], after the 0 that */
+/* marks an ACK                                                     */
+static void make_ack(struct pkt *pkt, int ack, int rwnd, enum checksum_type checksum) {
+    pkt->seqnum = 0;
+    pkt->acknum = ack;
+    pkt->length = 3;
+    memset(pkt->payload, 0, pkt->length);
+    rwnd = std::min(rwnd, 0xffff);
+    pkt->payload[1] = (char) (rwnd & 0xff);
+    pkt->payload[2] = (char) (rwnd >> 8);
+    pkt->checksum = make_checksum(checksum, *pkt);
 }
 
-
-bool is_corrupt(const struct pkt &pkt) {
-    return make_checksum(pkt) != pkt.checksum;
+static int get_rwnd(const struct pkt &pkt) {
+    return (unsigned char) pkt.payload[1] | (unsigned char) pkt.payload[2] << 8;
 }
 
-pkt make_ack(int ack) {
-    return make_pkt(0, ack, NULL);
+/* ACKs carry no payload; layer 5 never hands down a message starting with '\0' */
+static bool has_data(const struct pkt &pkt) {
+    return pkt.payload[0] != '\0';
 }
 
-std::ostream &operator<<(std::ostream &os, const msg &m) {
-    return os << "{msg: " << std::string(m.data, 20) << '}';
+static std::ostream &operator<<(std::ostream &os, const msg &m) {
+    return os << "{msg: " << std::string(m.data, m.length) << '}';
 }
 
-std::ostream &operator<<(std::ostream &os, const pkt &p) {
+static std::ostream &operator<<(std::ostream &os, const pkt &p) {
     os << "{seq: " << p.seqnum << ", ack:" << p.acknum << ", chks:" << p.checksum;
     if (p.payload[0] != '\0') {
-        os << ", payload:" << std::string(p.payload, 20);
+        os << ", payload:" << std::string(p.payload, p.length);
     }
     os << '}';
     return os;
-}
\ No newline at end of file
+}
+
+static protocol *make_gbn(struct simulation *sim) {
+    return new gbn(sim);
+}
+
+static protocol_registration registration("gbn", make_gbn);
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "../include/simulator.h"
+
+/**
+ * Checks if the array pointed to by input holds a valid number.
+ *
+ * @param  input char* to the array holding the value.
+ * @return TRUE or FALSE
+ */
+int isNumber(char *input)
+{
+    while (*input){
+        if (!isdigit(*input))
+            return 0;
+        else
+            input += 1;
+    }
+
+    return 1;
+}
+
+int read_arg_int(char c)
+{
+	if(!isNumber(optarg)) {
+		fprintf(stderr, "Invalid value for -%c\n", c);
+		exit(-1);
+	}
+	return atoi(optarg);
+}
+
+float read_arg_float(char c)
+{
+	float val = atof(optarg);
+	if(val < 0.0 || val > 1.0){
+		fprintf(stderr, "Invalid value for -%c\n", c);
+		exit(-1);
+	}
+	return val;
+}
+
+/* -z n, or -z min-max for sizes drawn from min to max */
+void read_arg_sizes(char c, int *min, int *max)
+{
+	char *dash = strchr(optarg, '-');
+	if(dash != NULL)
+		*dash = '\0';
+	*min = *max = read_arg_int(c);
+	if(dash != NULL) {
+		optarg = dash + 1;
+		*max = read_arg_int(c);
+	}
+	if(*min < 1 || *max < *min){
+		fprintf(stderr, "Invalid value for -%c\n", c);
+		exit(-1);
+	}
+}
+
+void display_usage(char *filename)
+{
+	printf("Usage:\n %s -s Seed -w Window size -m Number of messages to simulate -l Loss -c Corruption -t Average time between messages from sender's layer5 -v Tracing [-q Event queue: list|heap|calendar] [-r Random generator: xoshiro|rand] [-n Random stream] [-d Bidirectional] [-P Protocol options: name[=value],...] [-S Print simulator statistics] [-T Time series output file] [-B Layer 5 under backpressure: defer|drop] [-z Message size: bytes or min-max] [-M MTU: bytes per packet, header included]\n", filename);
+}
+
+int main(int argc, char **argv)
+{
+   struct sim_params params = {0};
+   struct sim_results results;
+   struct simulation *sim;
+   std::string error;
+   int opt;
+   int stats = 0;
+   const char *seriesfile = NULL;
+
+   params.queue = "heap";
+
+   //Check for number of arguments
+   if(argc < 15){
+   		fprintf(stderr, "Missing arguments!\n");
+		display_usage(argv[0]);
+		return -1;
+   }
+
+   /*
+    * Parse the arguments
+    * http://www.gnu.org/software/libc/manual/html_node/Example-of-Getopt.html
+    */
+    while((opt = getopt(argc, argv,"s:w:m:l:c:t:v:q:r:n:dP:ST:B:z:M:")) != -1){
+    	switch (opt){
+    		case 's':   params.seed = read_arg_int(opt);
+                    	break;
+            case 'w':   params.winsize = read_arg_int(opt);
+            			break;
+            case 'm': 	params.nsimmax = read_arg_int(opt);
+            			break;
+            case 'l': 	params.lossprob = read_arg_float(opt);
+            			break;
+            case 'c': 	params.corruptprob = read_arg_float(opt);
+            			break;
+            case 't': 	if((params.lambda = atof(optarg)) <= 0.0){
+            				fprintf(stderr, "Invalid value for -%c\n", opt);
+							exit(-1);
+            			}
+            			break;
+            case 'v': 	params.trace = read_arg_int(opt);
+            			break;
+            case 'q': 	params.queue = optarg;
+            			break;
+            case 'r': 	params.rng = optarg;
+            			break;
+            case 'n': 	params.stream = read_arg_int(opt);
+            			break;
+            case 'd': 	params.bidirectional = 1;
+            			break;
+            case 'P': 	params.options = optarg;
+            			break;
+            case 'S': 	stats = 1;
+            			break;
+            case 'T': 	seriesfile = optarg;
+            			params.timeseries = 1;
+            			break;
+            case 'B': 	params.layer5 = optarg;
+            			break;
+            case 'z': 	read_arg_sizes(opt, &params.msgsize, &params.msgsize_max);
+            			break;
+            case 'M': 	params.mtu = read_arg_int(opt);
+            			break;
+            case '?':
+           	default:    fprintf(stderr, "Invalid arguments!\n");
+						display_usage(argv[0]);
+						return -1;
+       }
+    }
+
+   if((sim = sim_create(&params, find_protocol(NULL), &error)) == NULL){
+   		fprintf(stderr, "%s\n", error.c_str());
+		display_usage(argv[0]);
+		return -1;
+   }
+   sim_run(sim);
+   sim_results(sim, &results);
+   sim_destroy(sim);
+   if (!results.error.empty()) {
+		fprintf(stderr, "%s\n", results.error.c_str());
+		return -1;
+   }
+
+   //Do NOT change any of the following printfs
+   printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n",results.time,results.nsim);
+
+   printf("\n");
+   printf("[PA2]%d packets sent from the Application Layer of Sender A[/PA2]\n", results.A_application);
+   printf("[PA2]%d packets sent from the Transport Layer of Sender A[/PA2]\n", results.A_transport);
+   printf("[PA2]%d packets received at the Transport layer of Receiver B[/PA2]\n", results.B_transport);
+   printf("[PA2]%d packets received at the Application layer of Receiver B[/PA2]\n", results.B_application);
+   printf("[PA2]Total time: %f time units[/PA2]\n", results.time);
+   printf("[PA2]Throughput: %f packets/time units[/PA2]\n", results.B_application/results.time);
+   printf("Throughput: %f bytes/time units\n", results.B_application_bytes/results.time);
+   if (results.A_deferred || results.A_dropped)
+      printf("Backpressure at A: %d messages deferred, %d dropped\n", results.A_deferred, results.A_dropped);
+
+   if (params.bidirectional) {
+      const struct sim_direction &ba = results.B_to_A;
+      printf("\nB to A:\n");
+      printf(" %d packets sent from the Application Layer of Sender B\n", ba.application_sent);
+      printf(" %d packets sent from the Transport Layer of Sender B\n", ba.transport_sent);
+      printf(" %d packets received at the Transport layer of Receiver A\n", ba.transport_received);
+      printf(" %d packets received at the Application layer of Receiver A\n", ba.application_received);
+      printf(" Throughput: %f packets/time units\n", ba.application_received/results.time);
+      printf(" Throughput: %f bytes/time units\n", ba.application_bytes_received/results.time);
+      if (ba.application_deferred || ba.application_dropped)
+         printf(" Backpressure at B: %d messages deferred, %d dropped\n", ba.application_deferred, ba.application_dropped);
+      printf("Both directions: %f packets sent per delivered message\n",
+             (double) (results.A_transport + ba.transport_sent) / (results.B_application + ba.application_received));
+   }
+
+   if (stats) {
+      printf("\nSimulator statistics:\n");
+      printf(" event queue: %s\n", results.queue);
+      printf(" random generator: %s\n", results.rng);
+      printf(" MTU: %d bytes\n", results.mtu);
+      printf(" packets into layer3: %d, lost: %d, corrupted: %d\n", results.ntolayer3, results.nlost, results.ncorrupt);
+      printf(" full event list scans: %d\n", results.nscans);
+      printf(" events processed: %lu\n", results.events_processed);
+      printf(" events: %lu allocated, %lu released, peak %lu in use\n",
+             results.events_allocated, results.events_released, results.events_peak);
+      printf(" heap allocations for events: %lu (capacity %lu)\n",
+             results.event_heap_allocations, results.event_capacity);
+      for (unsigned long i = 0; i < results.stats.size(); i++) {
+         const struct sim_series &st = results.stats[i];
+         printf(" %s: %lu samples, mean %f, deviation %f, min %f, max %f",
+                st.name.c_str(), st.count, st.mean(), st.deviation(), st.min, st.max);
+         if (st.has_percentiles())
+            printf(", p50 %f, p90 %f, p99 %f", st.percentile(50), st.percentile(90), st.percentile(99));
+         printf("\n");
+      }
+   }
+
+   if (seriesfile != NULL) {
+      FILE *out = fopen(seriesfile, "w");
+      if (out == NULL) {
+         perror(seriesfile);
+         return -1;
+      }
+      fprintf(out, "time,entity,name,value\n");
+      for (unsigned long i = 0; i < results.timeseries.size(); i++) {
+         const struct sim_point &p = results.timeseries[i];
+         fprintf(out, "%f,%c,%s,%g\n", p.time, p.entity ? 'B' : 'A', p.name, p.value);
+      }
+      fclose(out);
+   }
+   return 0;
+}
@@ -0,0 +1,69 @@
+#include <string.h>
+
+#include "../include/rng.h"
+
+rng::rng() : kind(XOSHIRO) {
+    memset(s, 0, sizeof(s));
+    memset(&compat, 0, sizeof(compat));
+}
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+bool rng::seed(const char *name, unsigned int seed, unsigned int stream) {
+    if (strcmp(name, "xoshiro") == 0) {
+        uint64_t x = seed;
+        kind = XOSHIRO;
+        for (int i = 0; i < 4; i++)
+            s[i] = splitmix64(&x);
+        for (unsigned int i = 0; i < stream; i++)
+            jump();
+        return true;
+    }
+    if (strcmp(name, "rand") == 0 && stream == 0) {
+        /* a 128 byte state is what srand()/rand() use */
+        kind = RAND;
+        memset(&compat, 0, sizeof(compat));
+        initstate_r(seed, compatstate, sizeof(compatstate), &compat);
+        return true;
+    }
+    return false;
+}
+
+void rng::fill(float *out, unsigned long n) {
+    if (kind == XOSHIRO) {
+        /* top 24 bits: every float in [0,1) on a 2^-24 grid */
+        for (unsigned long i = 0; i < n; i++)
+            out[i] = (next() >> 40) * (1.0f / 16777216.0f);
+    } else {
+        double mmm = 2147483647;   /* largest int */
+        int32_t r;
+        for (unsigned long i = 0; i < n; i++) {
+            random_r(&compat, &r);
+            out[i] = r / mmm;
+        }
+    }
+}
+
+const char *rng::name() const {
+    return kind == XOSHIRO ? "xoshiro" : "rand";
+}
+
+/* advance 2^128 draws */
+void rng::jump() {
+    static const uint64_t JUMP[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    uint64_t t[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++)
+        for (int b = 0; b < 64; b++) {
+            if (JUMP[i] & (1ULL << b))
+                for (int j = 0; j < 4; j++)
+                    t[j] ^= s[j];
+            next();
+        }
+    memcpy(s, t, sizeof(s));
+}
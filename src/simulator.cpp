@@ -1,41 +1,130 @@
 #include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
-#include <getopt.h>
-#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <deque>
 
 #include "../include/simulator.h"
+#include "../include/eventqueue.h"
+#include "../include/rng.h"
+
+struct simulation {
+   protocol *proto;
+
+   /* Statistics */
+   int A_application;
+   int A_transport;
+   int B_application;
+   int B_transport;
+   int A_deferred;
+   int A_dropped;
+   long A_application_bytes;
+   long B_application_bytes;
+   struct sim_direction B_to_A;
+
+   int win_size;
+   int msgsize, msgsize_max;  /* bytes per message, see sim_params */
+   int mtu;
+   int bidirectional;
+   std::vector<std::pair<std::string, std::string> > options;   /* name, value */
+   std::vector<struct sim_series> stats;
+   std::vector<const char *> statnames;   /* the name each series was first given */
+   int timeseries;            /* keep sim_sample() points */
+   std::vector<struct sim_point> points;
+   std::string error;         /* see sim_error() */
+
+   int TRACE;                 /* for my debugging */
+   int nsim;                  /* number of messages from 5 to 4 so far */
+   int nsimmax;               /* number of msgs to generate, then stop */
+   simtime_t time_local;
+   float lossprob;            /* probability that a packet is dropped  */
+   float corruptprob;         /* probability that one bit is packet is flipped */
+   float lambda;              /* arrival rate of messages from layer 5 */
+   int   ntolayer3;           /* number sent into layer 3 */
+   int   nlost;               /* number lost in media */
+   int ncorrupt;              /* number corrupted by media*/
+   int   nscans;              /* full walks over the event list */
+   unsigned long nevents;     /* events taken off the event list */
+
+   int profile;               /* time the sim_profile_points */
+   unsigned long profcalls[PROFILE_POINTS];
+   double profns[PROFILE_POINTS];
+
+   /* backpressure, see setbackpressure() */
+   int layer5drop;            /* drop messages instead of holding them */
+   int blocked[2];            /* the entity's sender is full */
+   /* messages layer 5 holds for each entity: their number and arrival */
+   std::deque<std::pair<int, simtime_t> > backlog[2];
+   /* when each message went to layer 4, per sender and by msgid from */
+   /* handedfirst; -1 once delivered or discarded                      */
+   std::deque<simtime_t> handed[2];
+   msgid_t handedfirst[2];
+
+   /* the medium is FIFO per direction; indexed by the receiving entity */
+   int   inflight[2];         /* packets in the medium heading to each side */
+   simtime_t lastarrival[2];  /* arrival time of the newest of them */
+
+   event_queue *evlist;       /* the event list */
+   event_pool evpool;         /* storage for events and their packets */
+
+   /* the pending TIMER_INTERRUPT of each entity, so starttimer/stoptimer */
+   /* never have to search the event list for it                          */
+   struct event *timerevent[2];
+   /* the same for numbered timers, indexed by timer id */
+   std::vector<struct event *> idtimerevent[2];
+
+   /* random numbers are drawn from rng a batch at a time */
+   class rng rng;
+   float draws[256];
+   int nextdraw;              /* first unused entry of draws */
+};
+
+/* the simulation sim_run() is running on this thread, for the original API */
+static __thread struct simulation *running = NULL;
+
+const char *const sim_profile_names[PROFILE_POINTS] = {
+   "insertevent", "tolayer3", "A_output", "A_input", "B_input", "B_output", "timerinterrupt"
+};
+
+static double profile_clock(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
 
-/* Statistics */
-int A_application = 0;
-int A_transport = 0;
-int B_application = 0;
-int B_transport = 0;
-
-int win_size;
-
-int TRACE = 1;             /* for my debugging */
-int nsim = 0;              /* number of messages from 5 to 4 so far */
-int nsimmax = 0;           /* number of msgs to generate, then stop */
-float time_local = 0;
-float lossprob;            /* probability that a packet is dropped  */
-float corruptprob;         /* probability that one bit is packet is flipped */
-float lambda;              /* arrival rate of messages from layer 5 */
-int   ntolayer3;           /* number sent into layer 3 */
-int   nlost;               /* number lost in media */
-int ncorrupt;              /* number corrupted by media*/
+/* run call, and with profiling on charge its time to point */
+#define PROFILE(sim, point, call) \
+   do { \
+      if ((sim)->profile) { \
+         double start_ = profile_clock(); \
+         call; \
+         (sim)->profns[point] += profile_clock() - start_; \
+         (sim)->profcalls[point]++; \
+         } \
+      else \
+         call; \
+   } while (0)
 
 /****************************************************************************/
 /* jimsrand(): return a float in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
+/* isolate all random number generation in one location.  Draws are taken   */
+/* in order from a buffer the simulation's generator refills in bulk, so    */
+/* the sequence is the same as drawing them one by one.                     */
 /****************************************************************************/
-float jimsrand() 
+static inline float jimsrand(struct simulation *sim)
 {
-  double mmm = 2147483647;   /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
-  float x;                   /* individual students may need to change mmm */ 
-  x = rand()/mmm;            /* x should be uniform in [0,1] */
-  return(x);
-}  
+  if (sim->nextdraw == (int) (sizeof(sim->draws)/sizeof(sim->draws[0]))) {
+     sim->rng.fill(sim->draws, sizeof(sim->draws)/sizeof(sim->draws[0]));
+     sim->nextdraw = 0;
+     }
+  return sim->draws[sim->nextdraw++];
+}
 
 
 /*****************************************************************
@@ -57,7 +146,7 @@ to, and you defeinitely should not have to modify
 
 
 /* possible events: */
-#define  TIMER_INTERRUPT 0  
+#define  TIMER_INTERRUPT 0
 #define  FROM_LAYER5     1
 #define  FROM_LAYER3     2
 
@@ -67,52 +156,13 @@ to, and you defeinitely should not have to modify
 #define   B    1
 
 
-struct event {
-   float evtime;           /* event time */
-   int evtype;             /* event type code */
-   int eventity;           /* entity where event occurs */
-   struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
-   struct event *prev;
-   struct event *next;
- };
-struct event *evlist = NULL;   /* the event list */
-
-
-void insertevent(struct event *p)
+static void insertevent(struct simulation *sim, struct event *p)
 {
-   struct event *q,*qold;
-
-   if (TRACE>2) {
-      printf("            INSERTEVENT: time is %lf\n",time_local);
-      printf("            INSERTEVENT: future time will be %lf\n",p->evtime); 
+   if (sim->TRACE>2) {
+      printf("            INSERTEVENT: time is %lf\n",sim->time_local);
+      printf("            INSERTEVENT: future time will be %lf\n",p->evtime);
       }
-   q = evlist;     /* q points to header of list in which p struct inserted */
-   if (q==NULL) {   /* list is empty */
-        evlist=p;
-        p->next=NULL;
-        p->prev=NULL;
-        }
-     else {
-        for (qold = q; q !=NULL && p->evtime > q->evtime; q=q->next)
-              qold=q; 
-        if (q==NULL) {   /* end of list */
-             qold->next = p;
-             p->prev = qold;
-             p->next = NULL;
-             }
-           else if (q==evlist) { /* front of list */
-             p->next=evlist;
-             p->prev=NULL;
-             p->next->prev=p;
-             evlist = p;
-             }
-           else {     /* middle of list */
-             p->next=q;
-             p->prev=q->prev;
-             q->prev->next=p;
-             q->prev=p;
-             }
-         }
+   PROFILE(sim, PROFILE_INSERTEVENT, sim->evlist->insert(p));
 }
 
 
@@ -123,193 +173,231 @@ void insertevent(struct event *p)
 /*  The next set of routines handle the event list   */
 /*****************************************************/
 
-void generate_next_arrival()
+static void generate_next_arrival(struct simulation *sim)
 {
-   double x,log(),ceil();
+   double x;
    struct event *evptr;
-//    //char *malloc();
-   float ttime;
-   int tempint;
 
-   if (TRACE>2)
+   if (sim->TRACE>2)
        printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
 
-   x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
-                             /* having mean of lambda        */
+   x = sim->lambda*jimsrand(sim)*2;  /* x is uniform on [0,2*lambda] */
+                                     /* having mean of lambda        */
 
-   evptr = (struct event *)malloc(sizeof(struct event));
-   evptr->evtime =  time_local + x;
+   evptr = sim->evpool.alloc();
+   evptr->evtime =  sim->time_local + x;
    evptr->evtype =  FROM_LAYER5;
-   if (BIDIRECTIONAL && (jimsrand()>0.5) )
+   if (sim->bidirectional && (jimsrand(sim)>0.5) )
       evptr->eventity = B;
     else
       evptr->eventity = A;
-   insertevent(evptr);
+   insertevent(sim, evptr);
 }
 
 
 
 
 
-void init(int seed)                         /* initialize the simulator */
+static void init(struct simulation *sim)   /* initialize the simulator */
 {
   int i;
   float sum, avg;
-  float jimsrand();
-  
-  /*
-   printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
-   printf("Enter the number of messages to simulate: ");
-   scanf("%d",&nsimmax);
-   printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-   scanf("%f",&lossprob);
-   printf("Enter packet corruption probability [0.0 for no corruption]:");
-   scanf("%f",&corruptprob);
-   printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-   scanf("%f",&lambda);
-   printf("Enter TRACE:");
-   scanf("%d",&TRACE);
-   */
-
-   srand(seed);              /* init random number generator */
+
+   sim->nextdraw = sizeof(sim->draws)/sizeof(sim->draws[0]);
    sum = 0.0;                /* test random number generator for students */
    for (i=0; i<1000; i++)
-      sum=sum+jimsrand();    /* jimsrand() should be uniform in [0,1] */
+      sum=sum+jimsrand(sim); /* jimsrand() should be uniform in [0,1] */
    avg = sum/1000.0;
-   if (avg < 0.25 || avg > 0.75) {
-    printf("It is likely that random number generation on your machine\n" ); 
-    printf("is different from what this emulator expects.  Please take\n");
-    printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
-    exit(0);
-    }
-
-   ntolayer3 = 0;
-   nlost = 0;
-   ncorrupt = 0;
-
-   time_local=0;                    /* initialize time to 0.0 */
-   generate_next_arrival();     /* initialize event list */
+   if (avg < 0.25 || avg > 0.75)   /* the run fails, see sim_error() */
+    sim_error(sim, "It is likely that random number generation on your machine "
+                   "is different from what this emulator expects.  Please take "
+                   "a look at the routine jimsrand() in the emulator code. Sorry.");
+
+   sim->ntolayer3 = 0;
+   sim->nlost = 0;
+   sim->ncorrupt = 0;
+   sim->nscans = 0;
+   sim->nevents = 0;
+   sim->inflight[A] = sim->inflight[B] = 0;
+   sim->blocked[A] = sim->blocked[B] = 0;
+   sim->backlog[A].clear();
+   sim->backlog[B].clear();
+   sim->handed[A].clear();
+   sim->handed[B].clear();
+   sim->handedfirst[A] = sim->handedfirst[B] = 0;
+   sim->timerevent[A] = sim->timerevent[B] = NULL;
+   sim->idtimerevent[A].clear();
+   sim->idtimerevent[B].clear();
+
+   sim->time_local=0;                /* initialize time to 0.0 */
+   generate_next_arrival(sim);   /* initialize event list */
 }
 
 
+/* "name[=value],..." */
+static void parse_options(struct simulation *sim, const char *options)
+{
+   std::string s(options);
+   for (std::string::size_type pos = 0; pos < s.size();) {
+      std::string::size_type end = s.find(',', pos);
+      if (end == std::string::npos)
+         end = s.size();
+      std::string item = s.substr(pos, end - pos);
+      std::string::size_type eq = item.find('=');
+      if (!item.empty())
+         sim->options.push_back(eq == std::string::npos
+                                ? std::make_pair(item, std::string())
+                                : std::make_pair(item.substr(0, eq), item.substr(eq + 1)));
+      pos = end + 1;
+      }
+}
 
 
+/* why sim_create() fails, if the caller asked */
+static struct simulation *create_failed(std::string *error, const char *format, ...)
+{
+   char text[256];
+   va_list args;
+   if (error != NULL) {
+      va_start(args, format);
+      vsnprintf(text, sizeof(text), format, args);
+      va_end(args);
+      *error = text;
+      }
+   return NULL;
+}
 
 
-//int TRACE = 1;             /* for my debugging */
-//int nsim = 0;              /* number of messages from 5 to 4 so far */ 
-//int nsimmax = 0;           /* number of msgs to generate, then stop */
-//float time = 0.000;
-//float lossprob;            /* probability that a packet is dropped  */
-//float corruptprob;         /* probability that one bit is packet is flipped */
-//float lambda;              /* arrival rate of messages from layer 5 */   
-//int   ntolayer3;           /* number sent into layer 3 */
-//int   nlost;               /* number lost in media */
-//int ncorrupt;              /* number corrupted by media*/
-
-/**
- * Checks if the array pointed to by input holds a valid number.
- *
- * @param  input char* to the array holding the value.
- * @return TRUE or FALSE
- */
-int isNumber(char *input)
+struct simulation *sim_create(const struct sim_params *params, protocol_factory make, std::string *error)
 {
-    while (*input){
-        if (!isdigit(*input))
-            return 0;
-        else
-            input += 1;
-    }
-
-    return 1;
+   struct simulation *sim;
+   event_queue *evlist;
+   const char *generator = params->rng ? params->rng : "xoshiro";
+
+   if (params->layer5 != NULL && strcmp(params->layer5, "defer") != 0 && strcmp(params->layer5, "drop") != 0)
+      return create_failed(error, "Unknown layer 5 backpressure: %s", params->layer5);
+   /* messages of 1 to MAX_PAYLOAD bytes, in packets that can carry them */
+   /* and, as the protocols' ACKs need, at least 20 bytes                 */
+   int msgsize = params->msgsize > 0 ? params->msgsize : 20;
+   int msgsize_max = std::max(msgsize, params->msgsize_max);
+   int mtu = params->mtu > 0 ? params->mtu : PKT_HEADER + std::max(msgsize_max, 20);
+   if (msgsize_max > MAX_PAYLOAD)
+      return create_failed(error, "Messages of %d bytes exceed the largest payload of %d", msgsize_max, MAX_PAYLOAD);
+   if (mtu > MAX_MTU)
+      return create_failed(error, "An MTU of %d exceeds the largest of %d", mtu, MAX_MTU);
+   if (mtu < PKT_HEADER + std::max(msgsize_max, 20))
+      return create_failed(error, "Messages of %d bytes need an MTU of %d", msgsize_max,
+                           PKT_HEADER + std::max(msgsize_max, 20));
+
+   sim = new simulation();
+   if (!sim->rng.seed(generator, params->seed, params->stream)) {
+      bool known = sim->rng.seed(generator, params->seed, 0);
+      delete sim;
+      return known ? create_failed(error, "Random generator %s has no stream %u", generator, params->stream)
+                   : create_failed(error, "Unknown random generator: %s", generator);
+      }
+   if ((evlist = make_event_queue(params->queue)) == NULL) {
+      delete sim;
+      return create_failed(error, "Unknown event queue: %s", params->queue);
+      }
+   sim->evlist = evlist;
+   sim->evpool.set_mtu(mtu);
+   sim->msgsize = msgsize;
+   sim->msgsize_max = msgsize_max;
+   sim->mtu = mtu;
+   sim->win_size = params->winsize;
+   sim->bidirectional = params->bidirectional;
+   sim->timeseries = params->timeseries;
+   sim->layer5drop = params->layer5 != NULL && strcmp(params->layer5, "drop") == 0;
+   if (params->options != NULL)
+      parse_options(sim, params->options);
+   sim->nsimmax = params->nsimmax;
+   sim->lossprob = params->lossprob;
+   sim->corruptprob = params->corruptprob;
+   sim->lambda = params->lambda;
+   sim->TRACE = params->trace;
+   sim->profile = params->profile;
+   init(sim);
+   sim->proto = make(sim);
+   return sim;
 }
 
-int read_arg_int(char c)
+
+void sim_destroy(struct simulation *sim)
 {
-	if(!isNumber(optarg)) {
-		fprintf(stderr, "Invalid value for -%c\n", c);
-		exit(-1);
-	}
-	return atoi(optarg);	
+   delete sim->proto;
+   delete sim->evlist;
+   delete sim;
 }
 
-float read_arg_float(char c)
+
+/* hand message number n from layer 5 to the entity */
+static void from_layer5(struct simulation *sim, int entity, int n)
 {
-	float val = atof(optarg);
-	if(val < 0.0 || val > 1.0){
-		fprintf(stderr, "Invalid value for -%c\n", c);
-		exit(-1);
-	}
-	return val;
+   struct msg  msg2give;
+   int i,j;
+
+   msg2give.length = sim->msgsize;
+   if (sim->msgsize_max > sim->msgsize)
+      msg2give.length += std::min((int) ((sim->msgsize_max - sim->msgsize + 1) * jimsrand(sim)),
+                                  sim->msgsize_max - sim->msgsize);
+   /* fill in msg to give with string of same letter */
+   j = n % 26;
+   memset(msg2give.data, 97 + j, msg2give.length);
+   if (sim->TRACE>2) {
+      printf("          MAINLOOP: data given to student: ");
+        for (i=0; i<msg2give.length; i++)
+         printf("%c", msg2give.data[i]);
+      printf("\n");
+    }
+   msg2give.msgid = sim->handedfirst[entity] + sim->handed[entity].size();
+   sim->handed[entity].push_back(sim->time_local);
+   if (entity == A)
+   {
+      sim->A_application += 1;
+      sim->A_application_bytes += msg2give.length;
+      PROFILE(sim, PROFILE_A_OUTPUT, sim->proto->A_send(msg2give));
+   }
+   else
+   {
+      sim->B_to_A.application_sent += 1;
+      sim->B_to_A.application_bytes_sent += msg2give.length;
+      PROFILE(sim, PROFILE_B_OUTPUT, sim->proto->B_send(msg2give));
+   }
 }
 
-void display_usage(char *filename)
+/* messages held under backpressure go in, oldest first, while the */
+/* sender takes them                                               */
+static void release_layer5(struct simulation *sim)
 {
-	printf("Usage:\n %s -s Seed -w Window size -m Number of messages to simulate -l Loss -c Corruption -t Average time between messages from sender's layer5 -v Tracing\n", filename);
+   for (int entity = A; entity <= B; entity++)
+      while (!sim->blocked[entity] && !sim->backlog[entity].empty()) {
+         std::pair<int, simtime_t> held = sim->backlog[entity].front();
+         sim->backlog[entity].pop_front();
+         sim_stat(sim, "layer5_wait", sim->time_local - held.second);
+         from_layer5(sim, entity, held.first);
+         }
 }
 
-int main(int argc, char **argv)
+
+void sim_run(struct simulation *sim)
 {
    struct event *eventptr;
-   struct msg  msg2give;
-   struct pkt  pkt2give;
-   
-   int i,j;
-   char c; 
-  
-   int opt;
-   int seed;
-
-   //Check for number of arguments
-   if(argc != 15){
-   		fprintf(stderr, "Missing arguments!\n");
-		display_usage(argv[0]);
-		return -1;
-   }
+   struct simulation *caller = running;
+   int n, entity;
+
+   running = sim;
+   sim->proto->A_init();
+   if (sim->error.empty())
+      sim->proto->B_init();
+   if (!sim->error.empty())
+      goto terminate;
 
-   /* 
-    * Parse the arguments 
-    * http://www.gnu.org/software/libc/manual/html_node/Example-of-Getopt.html 
-    */
-    while((opt = getopt(argc, argv,"s:w:m:l:c:t:v:")) != -1){
-    	switch (opt){
-    		case 's':   seed = read_arg_int(opt);
-                    	break;
-            case 'w':   win_size = read_arg_int(opt);
-            			break;
-            case 'm': 	nsimmax = read_arg_int(opt);
-            			break;
-            case 'l': 	lossprob = read_arg_float(opt);
-            			break;
-            case 'c': 	corruptprob = read_arg_float(opt);
-            			break;
-            case 't': 	if((lambda = atof(optarg)) <= 0.0){
-            				fprintf(stderr, "Invalid value for -%c\n", opt);
-							exit(-1);
-            			}		
-            			break;
-            case 'v': 	TRACE = read_arg_int(opt);
-            			break;
-            case '?':   
-           	default:    fprintf(stderr, "Invalid arguments!\n");
-						display_usage(argv[0]);
-						return -1;
-       }
-    }
-  
-   init(seed);
-   A_init();
-   B_init();
-   
    while (1) {
-        eventptr = evlist;            /* get next event to simulate */
+        eventptr = sim->evlist->pop();   /* get next event to simulate */
         if (eventptr==NULL)
            goto terminate;
-        evlist = evlist->next;        /* remove this event from event list */
-        if (evlist!=NULL)
-           evlist->prev=NULL;
-        if (TRACE>=2) {
+        if (sim->TRACE>=2) {
            printf("\nEVENT time: %f,",eventptr->evtime);
            printf("  type: %d",eventptr->evtype);
            if (eventptr->evtype==0)
@@ -320,112 +408,122 @@ int main(int argc, char **argv)
 	     printf(", fromlayer3 ");
            printf(" entity: %d\n",eventptr->eventity);
            }
-        time_local = eventptr->evtime;        /* update time to next event time */
-        if (nsim==nsimmax)
+        sim->time_local = eventptr->evtime;    /* update time to next event time */
+        if (sim->nsim==sim->nsimmax)
 	  break;                        /* all done with simulation */
+        sim->nevents++;
         if (eventptr->evtype == FROM_LAYER5 ) {
-            generate_next_arrival();   /* set up future arrival */
-            /* fill in msg to give with string of same letter */    
-            j = nsim % 26; 
-            for (i=0; i<20; i++)  
-               msg2give.data[i] = 97 + j;
-            if (TRACE>2) {
-               printf("          MAINLOOP: data given to student: ");
-                 for (i=0; i<20; i++) 
-                  printf("%c", msg2give.data[i]);
-               printf("\n");
-	     }
-            nsim++;
-            if (eventptr->eventity == A)
-            {
-            	A_application += 1;
-            	A_output(msg2give);
-            }  
-            /*
-             else
-               B_output(msg2give);  
-               */
+            generate_next_arrival(sim);   /* set up future arrival */
+            n = sim->nsim++;
+            entity = eventptr->eventity;
+            if (sim->blocked[entity] && sim->layer5drop) {
+               if (entity == A)
+                  sim->A_dropped += 1;
+               else
+                  sim->B_to_A.application_dropped += 1;
+               }
+            else if (sim->blocked[entity] || !sim->backlog[entity].empty()) {
+               /* hold it, see release_layer5() */
+               sim->backlog[entity].push_back(std::make_pair(n, sim->time_local));
+               if (entity == A)
+                  sim->A_deferred += 1;
+               else
+                  sim->B_to_A.application_deferred += 1;
+               }
+            else
+               from_layer5(sim, entity, n);
             }
           else if (eventptr->evtype ==  FROM_LAYER3) {
-            pkt2give.seqnum = eventptr->pktptr->seqnum;
-            pkt2give.acknum = eventptr->pktptr->acknum;
-            pkt2give.checksum = eventptr->pktptr->checksum;
-            for (i=0; i<20; i++)  
-                pkt2give.payload[i] = eventptr->pktptr->payload[i];
+            sim->inflight[eventptr->eventity]--;
 	    if (eventptr->eventity ==A)      /* deliver packet by calling */
-   	       A_input(pkt2give);            /* appropriate entity */
+            {                                /* appropriate entity */
+            	sim->B_to_A.transport_received += 1;
+            	PROFILE(sim, PROFILE_A_INPUT, sim->proto->A_receive(eventptr->pkt));
+            }
             else
             {
-            	B_transport += 1;
-            	B_input(pkt2give);
+            	sim->B_transport += 1;
+            	PROFILE(sim, PROFILE_B_INPUT, sim->proto->B_receive(eventptr->pkt));
             }
-	    free(eventptr->pktptr);          /* free the memory for packet */
             }
           else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-            if (eventptr->eventity == A) 
-	       A_timerinterrupt();
-	   		/*
-             else
-	       B_timerinterrupt();
-	       	*/
+            if (eventptr->evtimer >= 0) {
+               sim->idtimerevent[eventptr->eventity][eventptr->evtimer] = NULL;
+               if (eventptr->eventity == A)
+	          PROFILE(sim, PROFILE_TIMERINTERRUPT,
+	                  sim->proto->A_timerinterrupt_id(eventptr->evtimer));
+               else
+	          PROFILE(sim, PROFILE_TIMERINTERRUPT,
+	                  sim->proto->B_timerinterrupt_id(eventptr->evtimer));
+               }
+            else {
+               sim->timerevent[eventptr->eventity] = NULL;
+               if (eventptr->eventity == A)
+	          PROFILE(sim, PROFILE_TIMERINTERRUPT, sim->proto->A_timerinterrupt());
+               else
+	          PROFILE(sim, PROFILE_TIMERINTERRUPT, sim->proto->B_timerinterrupt());
+               }
              }
           else  {
-	     printf("INTERNAL PANIC: unknown event type \n");
+	     fprintf(stderr, "INTERNAL PANIC: unknown event type \n");
              }
-        free(eventptr);
+        if (!sim->backlog[A].empty() || !sim->backlog[B].empty())
+           release_layer5(sim);
+        sim->evpool.release(eventptr);
         }
 
 terminate:
-   //Do NOT change any of the following printfs
-   printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n",time_local,nsim);
-
-   printf("\n");
-   printf("[PA2]%d packets sent from the Application Layer of Sender A[/PA2]\n", A_application);
-   printf("[PA2]%d packets sent from the Transport Layer of Sender A[/PA2]\n", A_transport);
-   printf("[PA2]%d packets received at the Transport layer of Receiver B[/PA2]\n", B_transport);
-   printf("[PA2]%d packets received at the Application layer of Receiver B[/PA2]\n", B_application);
-   printf("[PA2]Total time: %f time units[/PA2]\n", time_local);
-   printf("[PA2]Throughput: %f packets/time units[/PA2]\n", B_application/time_local);
-   return 0;
+   running = caller;
 }
 
 
-/********************* EVENT HANDLINE ROUTINES *******/
-/*  The next set of routines handle the event list   */
-/*****************************************************/
- 
-/*void generate_next_arrival()
+void sim_results(const struct simulation *sim, struct sim_results *results)
 {
-   double x,log(),ceil();
-   struct event *evptr;
-    //char *malloc();
-   float ttime;
-   int tempint;
-
-   if (TRACE>2)
-       printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
- 
-   x = lambda*jimsrand()*2;  // x is uniform on [0,2*lambda] 
-                             // having mean of lambda       
-   evptr = (struct event *)malloc(sizeof(struct event));
-   evptr->evtime =  time + x;
-   evptr->evtype =  FROM_LAYER5;
-   if (BIDIRECTIONAL && (jimsrand()>0.5) )
-      evptr->eventity = B;
-    else
-      evptr->eventity = A;
-   insertevent(evptr);
-} */
-
-
+   results->A_application = sim->A_application;
+   results->A_transport = sim->A_transport;
+   results->B_transport = sim->B_transport;
+   results->B_application = sim->B_application;
+   results->A_application_bytes = sim->A_application_bytes;
+   results->B_application_bytes = sim->B_application_bytes;
+   results->A_deferred = sim->A_deferred;
+   results->A_dropped = sim->A_dropped;
+   results->B_to_A = sim->B_to_A;
+   results->time = sim->time_local;
+   results->nsim = sim->nsim;
+   results->mtu = sim->mtu;
+   results->ntolayer3 = sim->ntolayer3;
+   results->nlost = sim->nlost;
+   results->ncorrupt = sim->ncorrupt;
+   results->nscans = sim->nscans;
+   results->queue = sim->evlist->name();
+   results->rng = sim->rng.name();
+   results->events_allocated = sim->evpool.allocations();
+   results->events_released = sim->evpool.releases();
+   results->events_peak = sim->evpool.peak_in_use();
+   results->event_heap_allocations = sim->evpool.heap_allocations();
+   results->event_capacity = sim->evpool.capacity();
+   results->events_processed = sim->nevents;
+   for (int i = 0; i < PROFILE_POINTS; i++) {
+      results->profile_calls[i] = sim->profcalls[i];
+      results->profile_ns[i] = sim->profns[i];
+      }
+   results->stats = sim->stats;
+   results->timeseries = sim->points;
+   results->error = sim->error;
+}
 
 
-void printevlist()
+void printevlist(struct simulation *sim)
 {
+  std::vector<struct event *> pending;
   struct event *q;
-  int i;
+  unsigned long i;
   printf("--------------\nEvent List Follows:\n");
-  for(q = evlist; q!=NULL; q=q->next) {
+  sim->nscans++;
+  sim->evlist->collect(pending);
+  std::sort(pending.begin(), pending.end(), event_before);
+  for(i = 0; i<pending.size(); i++) {
+    q = pending[i];
     printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
     }
   printf("--------------\n");
@@ -436,157 +534,513 @@ void printevlist()
 /********************** Student-callable ROUTINES ***********************/
 
 /* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB)
+void stoptimer(struct simulation *sim, int AorB)
  //AorB;  /* A or B is trying to stop timer */
 {
- struct event *q,*qold;
+ struct event *q;
 
- if (TRACE>2)
-    printf("          STOP TIMER: stopping timer at %f\n",time_local);
-/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
- for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
+ if (sim->TRACE>2)
+    printf("          STOP TIMER: stopping timer at %f\n",sim->time_local);
+ if ((q = sim->timerevent[AorB]) != NULL) {
        /* remove this event */
-       if (q->next==NULL && q->prev==NULL)
-             evlist=NULL;         /* remove first and only event on list */
-          else if (q->next==NULL) /* end of list - there is one in front */
-             q->prev->next = NULL;
-          else if (q==evlist) { /* front of list - there must be event after */
-             q->next->prev=NULL;
-             evlist = q->next;
-             }
-           else {     /* middle of list */
-             q->next->prev = q->prev;
-             q->prev->next =  q->next;
-             }
-       free(q);
+       sim->evlist->remove(q);
+       sim->timerevent[AorB] = NULL;
+       sim->evpool.release(q);
        return;
      }
-  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+  fprintf(stderr, "Warning: unable to cancel your timer. It wasn't running.\n");
 }
 
 
-void starttimer(int AorB,float increment)
+void starttimer(struct simulation *sim, int AorB, simtime_t increment)
 // AorB;  /* A or B is trying to stop timer */
 
 {
 
- struct event *q;
  struct event *evptr;
- ////char *malloc();
 
- if (TRACE>2)
-    printf("          START TIMER: starting timer at %f\n",time_local);
+ if (sim->TRACE>2)
+    printf("          START TIMER: starting timer at %f\n",sim->time_local);
  /* be nice: check to see if timer is already started, if so, then  warn */
-/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-   for (q=evlist; q!=NULL ; q = q->next)  
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      printf("Warning: attempt to start a timer that is already started\n");
+   if (sim->timerevent[AorB] != NULL) {
+      fprintf(stderr, "Warning: attempt to start a timer that is already started\n");
       return;
       }
- 
+
 /* create future event for when timer goes off */
-   evptr = (struct event *)malloc(sizeof(struct event));
-   evptr->evtime =  time_local + increment;
+   evptr = sim->evpool.alloc();
+   evptr->evtime =  sim->time_local + increment;
    evptr->evtype =  TIMER_INTERRUPT;
    evptr->eventity = AorB;
-   insertevent(evptr);
-} 
+   evptr->evtimer = -1;
+   sim->timerevent[AorB] = evptr;
+   insertevent(sim, evptr);
+}
 
 
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB,struct pkt packet)
+/* numbered timers: any number of independent timers per entity, each */
+/* firing A_timerinterrupt_id(id) once.  Ids are small non-negative    */
+/* ints (e.g. sequence numbers); handle storage grows to the largest.  */
+void stoptimer_id(struct simulation *sim, int AorB, int id)
 {
- struct pkt *mypktptr;
- struct event *evptr,*q;
- ////char *malloc();
- float lastime, x, jimsrand();
- int i;
+ struct event *q;
+ std::vector<struct event *> &handles = sim->idtimerevent[AorB];
+
+ if (sim->TRACE>2)
+    printf("          STOP TIMER %d: stopping timer at %f\n",id,sim->time_local);
+ if (id >= 0 && (unsigned long) id < handles.size()
+     && (q = handles[id]) != NULL) {
+       sim->evlist->remove(q);
+       handles[id] = NULL;
+       sim->evpool.release(q);
+       return;
+     }
+  fprintf(stderr, "Warning: unable to cancel your timer %d. It wasn't running.\n",id);
+}
+
+
+void starttimer_id(struct simulation *sim, int AorB, int id, simtime_t increment)
+{
+ struct event *evptr;
+ std::vector<struct event *> &handles = sim->idtimerevent[AorB];
+
+ if (sim->TRACE>2)
+    printf("          START TIMER %d: starting timer at %f\n",id,sim->time_local);
+ if (id < 0) {
+      fprintf(stderr, "Warning: timer id %d is negative, not started\n",id);
+      return;
+      }
+ if ((unsigned long) id >= handles.size())
+    handles.resize(id + 1, (struct event *) NULL);
+ if (handles[id] != NULL) {
+      fprintf(stderr, "Warning: attempt to start timer %d that is already started\n",id);
+      return;
+      }
+
+   evptr = sim->evpool.alloc();
+   evptr->evtime =  sim->time_local + increment;
+   evptr->evtype =  TIMER_INTERRUPT;
+   evptr->eventity = AorB;
+   evptr->evtimer = id;
+   handles[id] = evptr;
+   insertevent(sim, evptr);
+}
 
 
- ntolayer3++;
+/************************** TOLAYER3 ***************/
+/* counts a packet into layer 3; 1 if the medium loses it */
+static int lost(struct simulation *sim, int AorB)
+{
+ sim->ntolayer3++;
 
- if(AorB == 0) A_transport += 1;
+ if(AorB == 0) sim->A_transport += 1;
+ else sim->B_to_A.transport_sent += 1;
 
  /* simulate losses: */
- if (jimsrand() < lossprob)  {
-      nlost++;
-      if (TRACE>0)    
+ if (jimsrand(sim) < sim->lossprob)  {
+      sim->nlost++;
+      if (sim->TRACE>0)
 	printf("          TOLAYER3: packet being lost\n");
-      return;
-    }  
-
-/* make a copy of the packet student just gave me since he/she may decide */
-/* to do something with the packet after we return back to him/her */ 
- mypktptr = (struct pkt *)malloc(sizeof(struct pkt));
- mypktptr->seqnum = packet.seqnum;
- mypktptr->acknum = packet.acknum;
- mypktptr->checksum = packet.checksum;
- for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
- if (TRACE>2)  {
+      return 1;
+    }
+ return 0;
+}
+
+/* schedules the arrival of the packet in evptr at the other side */
+static void launch(struct simulation *sim, int AorB, struct event *evptr)
+{
+ struct pkt *mypktptr = &evptr->pkt;
+ simtime_t lastime;
+ float x;
+ int i;
+
+ if (sim->TRACE>2)  {
    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
 	  mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
+    for (i=0; i<mypktptr->length; i++)
         printf("%c",mypktptr->payload[i]);
     printf("\n");
    }
-
-/* create future event for arrival of packet at the other side */
-  evptr = (struct event *)malloc(sizeof(struct event));
   evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
   evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
-  evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
 /* finally, compute the arrival time of packet at the other end.
    medium can not reorder, so make sure packet arrives between 1 and 10
    time units after the latest arrival time of packets
    currently in the medium on their way to the destination */
- lastime = time_local;
-/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
- for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
- evptr->evtime =  lastime + 1 + 9*jimsrand();
- 
+ lastime = sim->time_local;
+ if (sim->inflight[evptr->eventity] > 0)
+    lastime = sim->lastarrival[evptr->eventity];
+ evptr->evtime =  lastime + 1 + 9*jimsrand(sim);
+ sim->inflight[evptr->eventity]++;
+ sim->lastarrival[evptr->eventity] = evptr->evtime;
+
 
 
  /* simulate corruption: */
- if (jimsrand() < corruptprob)  {
-    ncorrupt++;
-    if ( (x = jimsrand()) < .75)
+ if (jimsrand(sim) < sim->corruptprob)  {
+    sim->ncorrupt++;
+    if ( (x = jimsrand(sim)) < .75)
        mypktptr->payload[0]='Z';   /* corrupt payload */
       else if (x < .875)
        mypktptr->seqnum = 999999;
       else
        mypktptr->acknum = 999999;
-    if (TRACE>0)    
+    if (sim->TRACE>0)
 	printf("          TOLAYER3: packet being corrupted\n");
-    }  
+    }
 
-  if (TRACE>2)  
+  if (sim->TRACE>2)
      printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
-} 
+  insertevent(sim, evptr);
+}
+
+static void transmit(struct simulation *sim, int AorB, const struct pkt &packet)
+{
+ struct event *evptr;
+
+ if (packet.length < 0 || pkt_size(packet) > sim->mtu) {
+    fprintf(stderr, "Warning: packet of %d bytes does not fit the MTU of %d, not sent\n",
+            pkt_size(packet), sim->mtu);
+    return;
+    }
+ if (lost(sim, AorB))
+    return;
+
+/* create future event for arrival of packet at the other side, with */
+/* a copy of the packet student just gave me since he/she may decide */
+/* to do something with the packet after we return back to him/her */
+  evptr = sim->evpool.alloc();
+  copy_pkt(&evptr->pkt, packet);
+  launch(sim, AorB, evptr);
+}
+
+/* the packet is already in its event, see newpacket() */
+static void transmit_in_place(struct simulation *sim, int AorB, struct pkt *packet)
+{
+ struct event *evptr = (struct event *) ((char *) packet - offsetof(struct event, pkt));
+
+ if (lost(sim, AorB)) {
+    sim->evpool.release(evptr);
+    return;
+    }
+ launch(sim, AorB, evptr);
+}
+
+void tolayer3(struct simulation *sim, int AorB, const struct pkt &packet)
+{
+  PROFILE(sim, PROFILE_TOLAYER3, transmit(sim, AorB, packet));
+}
+
+/* at least the 20 bytes every packet had, for version 1 protocols */
+void copy_pkt(struct pkt *to, const struct pkt &from)
+{
+  memcpy(to, &from, pkt_storage(PKT_HEADER + std::max(from.length, 20)));
+}
 
-void tolayer5(int AorB,char *datasent)
+void protocol::A_receive(const struct pkt &packet)
 {
-  
-  int i;  
-  if (TRACE>2) {
+  struct pkt copy;
+  copy_pkt(&copy, packet);
+  A_input(copy);
+}
+
+void protocol::B_receive(const struct pkt &packet)
+{
+  struct pkt copy;
+  copy_pkt(&copy, packet);
+  B_input(copy);
+}
+
+struct pkt *newpacket(struct simulation *sim)
+{
+  struct event *evptr = sim->evpool.alloc();
+  memset(&evptr->pkt, 0, pkt_storage(sim->mtu));
+  return &evptr->pkt;
+}
+
+void sendpacket(struct simulation *sim, int AorB, struct pkt *packet)
+{
+  PROFILE(sim, PROFILE_TOLAYER3, transmit_in_place(sim, AorB, packet));
+}
+
+/* when sender's message msgid went to layer 4, or -1 if it is delivered */
+/* or discarded already, or no msgid of sender's at all                   */
+static simtime_t handed_time(struct simulation *sim, int sender, msgid_t msgid)
+{
+  std::deque<simtime_t> &handed = sim->handed[sender];
+  msgid_t i = msgid - sim->handedfirst[sender];
+  return i < handed.size() ? handed[i] : -1;
+}
+
+/* sender's message msgid has been delivered: how long ago it went to */
+/* layer 4, or -1 if it was delivered before or is none of sender's   */
+static simtime_t delivered(struct simulation *sim, int sender, msgid_t msgid)
+{
+  std::deque<simtime_t> &handed = sim->handed[sender];
+  simtime_t time = handed_time(sim, sender, msgid);
+  if (time < 0)
+     return -1;
+  handed[msgid - sim->handedfirst[sender]] = -1;
+  while (!handed.empty() && handed.front() < 0) {
+     handed.pop_front();
+     sim->handedfirst[sender]++;
+     }
+  return sim->time_local - time;
+}
+
+void tolayer5(struct simulation *sim, int AorB, const char *datasent, int length, msgid_t msgid)
+{
+
+  int i;
+  if (sim->TRACE>2) {
      printf("          TOLAYER5: data received: ");
-     for (i=0; i<20; i++)  
+     for (i=0; i<length; i++)
         printf("%c",datasent[i]);
      printf("\n");
    }
-  if(AorB == 1) B_application += 1;
+  if(AorB == 1) {
+     sim->B_application += 1;
+     sim->B_application_bytes += length;
+     }
+  else {
+     sim->B_to_A.application_received += 1;
+     sim->B_to_A.application_bytes_received += length;
+     }
+  simtime_t delay = delivered(sim, 1 - AorB, msgid);
+  if (delay >= 0)
+     sim_distribution(sim, AorB == 1 ? "delay" : "reverse_delay", delay);
+}
+
+void tolayer5(struct simulation *sim, int AorB, const char *datasent)
+{
+  tolayer5(sim, AorB, datasent, 20, NO_MSGID);
+}
+
+int getwinsize(struct simulation *sim)
+{
+	return sim->win_size;
+}
+
+int getmtu(struct simulation *sim)
+{
+	return sim->mtu;
+}
+
+int getmaxmsgsize(struct simulation *sim)
+{
+	return sim->msgsize_max;
+}
+
+simtime_t get_sim_time(struct simulation *sim)
+{
+	return sim->time_local;
+}
+
+simtime_t get_msg_age(struct simulation *sim, int AorB, msgid_t msgid)
+{
+	simtime_t time = handed_time(sim, 1 - AorB, msgid);
+	return time < 0 ? -1 : sim->time_local - time;
+}
+
+int gettrace(struct simulation *sim)
+{
+	return sim->TRACE;
+}
+
+int getbidirectional(struct simulation *sim)
+{
+	return sim->bidirectional;
+}
+
+void setbackpressure(struct simulation *sim, int AorB, int on)
+{
+	sim->blocked[AorB] = on;
+}
+
+const char *getoption(struct simulation *sim, const char *name)
+{
+	for (unsigned long i = 0; i < sim->options.size(); i++)
+		if (sim->options[i].first == name)
+			return sim->options[i].second.c_str();
+	return NULL;
+}
+
+double getoption(struct simulation *sim, const char *name, double dflt)
+{
+	const char *value = getoption(sim, name);
+	return value != NULL && *value != '\0' ? atof(value) : dflt;
+}
+
+void sim_discard(struct simulation *sim, int AorB)
+{
+	std::deque<simtime_t> &handed = sim->handed[AorB];
+	if (!handed.empty())
+		handed.back() = -1;
+	while (!handed.empty() && handed.front() < 0) {
+		handed.pop_front();
+		sim->handedfirst[AorB]++;
+	}
+}
+
+void sim_error(struct simulation *sim, const char *format, ...)
+{
+	char text[256];
+	va_list args;
+	if (!sim->error.empty())
+		return;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	sim->error = text;
+}
+
+/* a handful of series per protocol, so a linear search on the name's */
+/* pointer finds them; comparing the text catches copies of the name  */
+static struct sim_series &add_sample(struct simulation *sim, const char *name, double value)
+{
+	std::vector<struct sim_series> &stats = sim->stats;
+	unsigned long i;
+	for (i = 0; i < stats.size(); i++)
+		if (sim->statnames[i] == name || stats[i].name == name)
+			break;
+	if (i == stats.size()) {
+		struct sim_series series = {name, 0, 0, 0, value, value};
+		stats.push_back(series);
+		sim->statnames.push_back(name);
+	}
+	struct sim_series &series = stats[i];
+	series.count++;
+	series.sum += value;
+	series.sumsq += value * value;
+	series.min = std::min(series.min, value);
+	series.max = std::max(series.max, value);
+	return series;
+}
+
+void sim_stat(struct simulation *sim, const char *name, double value)
+{
+	add_sample(sim, name, value);
+}
+
+void sim_distribution(struct simulation *sim, const char *name, double value)
+{
+	struct sim_series &series = add_sample(sim, name, value);
+	if (series.buckets.empty())
+		series.buckets.resize(SERIES_BUCKETS);
+	int i = 0;
+	if (value > 0) {
+		double b = floor(log2(value) * SERIES_BUCKETS_OCTAVE) + SERIES_BUCKET_ONE + 1;
+		i = (int) std::max(0.0, std::min(b, (double) SERIES_BUCKETS - 1));
+	}
+	series.buckets[i]++;
+}
+
+double sim_series::mean() const
+{
+	return count ? sum / count : 0;
+}
+
+double sim_series::deviation() const
+{
+	if (count < 2)
+		return 0;
+	double m = mean();
+	return sqrt(std::max(0.0, sumsq / count - m * m));
+}
+
+/* the top of the bucket the p-th percentile sample falls in */
+double sim_series::percentile(double p) const
+{
+	if (buckets.empty() || count == 0)
+		return 0;
+	unsigned long rank = std::max(1UL, (unsigned long) ceil(p / 100 * count)), seen = 0;
+	unsigned long i;
+	for (i = 0; i + 1 < buckets.size(); i++)
+		if ((seen += buckets[i]) >= rank)
+			break;
+	double top = pow(2.0, (double) ((int) i - SERIES_BUCKET_ONE) / SERIES_BUCKETS_OCTAVE);
+	return std::max(min, std::min(max, top));
+}
+
+void sim_sample(struct simulation *sim, int AorB, const char *name, double value)
+{
+	if (!sim->timeseries)
+		return;
+	struct sim_point point = {sim->time_local, AorB, name, value};
+	sim->points.push_back(point);
+}
+
+
+/********************** Original single-simulation API ***********************/
+
+void starttimer(int AorB, float increment)
+{
+	starttimer(running, AorB, increment);
+}
+
+void stoptimer(int AorB)
+{
+	stoptimer(running, AorB);
+}
+
+void starttimer_id(int AorB, int id, float increment)
+{
+	starttimer_id(running, AorB, id, increment);
+}
+
+void stoptimer_id(int AorB, int id)
+{
+	stoptimer_id(running, AorB, id);
+}
+
+void tolayer3(int AorB, struct pkt packet)
+{
+	packet.length = 20;
+	tolayer3(running, AorB, packet);
+}
+
+void tolayer5(int AorB, char *datasent)
+{
+	tolayer5(running, AorB, datasent);
 }
 
 int getwinsize()
 {
-	return win_size;
+	return getwinsize(running);
 }
 
 float get_sim_time()
 {
-	return time_local;
-}
\ No newline at end of file
+	return get_sim_time(running);
+}
+
+
+/********************** Protocol registry ***********************/
+
+struct registered_protocol {
+	const char *name;
+	protocol_factory make;
+};
+
+/* a function-local static, so registrations from other files' static */
+/* initializers never run before it is constructed                     */
+static std::vector<registered_protocol> &registry()
+{
+	static std::vector<registered_protocol> protocols;
+	return protocols;
+}
+
+protocol_registration::protocol_registration(const char *name, protocol_factory make)
+{
+	registered_protocol p = {name, make};
+	registry().push_back(p);
+}
+
+protocol_factory find_protocol(const char *name)
+{
+	std::vector<registered_protocol> &protocols = registry();
+	for (unsigned long i = 0; i < protocols.size(); i++)
+		if (name == NULL || strcmp(name, protocols[i].name) == 0)
+			return protocols[i].make;
+	return NULL;
+}
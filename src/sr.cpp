@@ -1,11 +1,22 @@
 #include "../include/simulator.h"
+#include "../include/window.h"
+#include "../include/congestion.h"
+#include "../include/checksum.h"
+#include "../include/coalesce.h"
+#include "../include/fec.h"
+#include "../include/transport.h"
 #include <iostream>
 #include <cstring>
-#include <set>
+#include <cstdio>
+#include <string>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <iomanip>
 #include <cmath>
+#include <climits>
+#include <cfloat>
+#include <cstdlib>
+#include <algorithm>
 /* ******************************************************************
  ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
 
@@ -20,261 +31,1047 @@
 **********************************************************************/
 
 /********* STUDENTS WRITE THE NEXT SEVEN ROUTINES *********/
-#define DEBUG_LOG(AorB, str) do { std::cout << std::setprecision(5) << std::setw(8) << get_sim_time() << "T: " << std::setw(3) << __LINE__  << "L: " << AorB << " : " << str << std::endl; } while( false )
+#define DEBUG_LOG(AorB, str) do { if (gettrace(sim) > 0) std::cout << std::setprecision(5) << std::setw(8) << get_sim_time(sim) << "T: " << std::setw(3) << __LINE__  << "L: " << (AorB) << " : " << str << std::endl; } while( false )
 #define DEBUG_A(str) DEBUG_LOG('A', str)
 #define DEBUG_B(str) DEBUG_LOG('B', str)
+#define DEBUG_SIDE(AorB, str) DEBUG_LOG((AorB) ? 'B' : 'A', str)
 
-std::ostream &operator<<(std::ostream &, const pkt &);
+static std::ostream &operator<<(std::ostream &, const pkt &);
 
-std::ostream &operator<<(std::ostream &, const msg &);
+static std::ostream &operator<<(std::ostream &, const msg &);
 
-pkt make_pkt(int seq, int ack, const struct msg *msg);
+static void make_pkt(struct pkt *pkt, int seq, int ack, const struct msg *msg, enum checksum_type checksum);
 
-pkt make_ack(int ack);
+static void make_ack(struct pkt *pkt, int ack, int rwnd, enum checksum_type checksum);
 
-int make_checksum(const struct pkt &pkt);
+static int get_rwnd(const struct pkt &pkt);
 
-bool is_corrupt(const struct pkt &pkt);
+static bool has_data(const struct pkt &pkt);
 
-/* Timer */
-static float initial_rtt = 10.0f,
-        alpha = 0.125f,
-        beta = 0.25f,
-        SampleRTT = initial_rtt,
-        EstimatedRTT = initial_rtt,
-        DevRTT = 0.0f;
+/* With option "sack" an ACK's acknum is the receiver's cumulative point */
+/* (rcvbase - 1), its seqnum the packet it answers, and payload bytes     */
+/* SACK_OFFSET on a bitmap of the SACK_BITS sequence numbers after        */
+/* rcvbase; bit i is set if rcvbase + 1 + i has arrived.  Byte 0 stays    */
+/* '\0', so the ACK still carries no data, and bytes 1-2 hold the        */
+/* advertised window as in every ACK.  Data packets carry the cumulative  */
+/* point alone.                                                           */
+enum { SACK_OFFSET = 4, SACK_BITS = (20 - SACK_OFFSET) * 8 };
 
-float TimeoutInterval();
+static void make_sack(struct pkt *pkt, int seq, int ack, int rwnd, const unsigned char *bitmap,
+                      enum checksum_type checksum);
 
-static const float CLOCK_TICK = 0.1;
+/* With option "streams" a data packet's payload starts with its stream */
+/* plus 1, so it is never '\0', and its sequence number in the stream    */
+/* (2 bytes, low byte first); the message follows.                       */
+enum { STREAM_HEADER = 3, MAX_STREAMS = 16 };
 
-struct timer {
-    int seq;
-    float time;
+static void make_stream_pkt(struct pkt *pkt, int seq, int ack, int stream, int streamseq,
+                            const struct msg *msg, enum checksum_type checksum);
 
-    bool operator<(const timer &t) const {
-        return time > t.time;
-    }
-
-    friend std::ostream &operator<<(std::ostream &os, const timer &t) {
-        return os << "{seq: " << t.seq << ", time:" << t.time << '}';
-    }
-};
-
-static std::priority_queue<timer> timers;
-static std::set<int> cancelled_timers;
-
-void start_timer(int seq, float time);
-
-void cancel_timer(int seq);
+static int get_stream(const struct pkt &pkt);
 
-/* Timer */
+static seqnum_t get_streamseq(const struct pkt &pkt);
 
 // A
 struct A_buffer {
-    struct pkt pkt;
     bool acked;
     bool retransmitted;
-    float sent_time;
+    simtime_t sent_time;    /* of the last transmission */
+    struct pkt pkt;         /* last, see packet_window */
 };
-static std::vector<A_buffer> A_sndpkt(1100);
-static std::queue<msg> A_buffer;
-static int send_base = 1, nextseqnum = 1, N;
-
-void send_buffered();
 
 // B
 struct B_buffer {
-    struct pkt pkt;
     bool acked;
+    struct pkt pkt;         /* last, see packet_window */
+};
+
+/* a packet of a stream waiting for an earlier one, by its stream seq */
+struct B_held {
+    bool held;
+    seqnum_t seqnum;
+};
+
+/* One stream of the option streams, as both ends see it */
+struct stream {
+    // sender
+    unsigned short nextseq;
+
+    // receiver
+    unsigned short expected;
+    ring_window<struct B_held> held;    /* the window seqnum of each packet ahead of expected */
+};
+
+class sr : public protocol {
+public:
+    explicit sr(struct simulation *sim);
+
+    ~sr();
+
+    void A_send(const struct msg &message);
+
+    void A_receive(const struct pkt &packet);
+
+    void A_timerinterrupt();
+
+    void A_timerinterrupt_id(int slot);
+
+    void A_init();
+
+
+    void B_receive(const struct pkt &packet);
+
+    void B_init();
+
+    void B_send(const struct msg &message);
+
+    void B_timerinterrupt_id(int slot);
+
+private:
+    /* Timer */
+    simtime_t initial_rtt;
+    float alpha,
+            beta;
+
+    /* Each entity runs a sender for its own data and a receiver for the */
+    /* other's.  A data packet carries the sequence number its receiver  */
+    /* acknowledged last, so in bidirectional runs an ACK only goes out  */
+    /* alone when no data leaves in the same input event.                */
+    struct entity {
+        simtime_t SampleRTT,
+                EstimatedRTT,
+                DevRTT;
+
+        // sender
+        packet_window<struct A_buffer> A_sndpkt;
+        message_queue A_buffer;
+        seqnum_t send_base, nextseqnum;
+        int N;
+        congestion_control *cc;
+        int rwnd;           /* window the other side advertised last */
+        int dupacks;        /* fresh ACKs above an unacked send_base */
+        bool recovering;    /* fast retransmit sent, recover not yet ACKed */
+        seqnum_t recover;   /* last packet outstanding at fast retransmit */
+        /* with rack: transmissions not answered yet, in order */
+        std::deque<std::pair<seqnum_t, simtime_t> > sent;
+        simtime_t rack_xmit;    /* last transmission known to have arrived */
+        seqnum_t rack_seq;      /* its packet */
+        simtime_t rack_rtt;     /* its RTT */
+        simtime_t min_rtt;      /* least RTT sample */
+        bool racktimer;         /* the RACK timer is running */
+        bool coalescetimer;     /* the coalescing timer is running */
+        bool flush;             /* queued messages have waited coalescedelay */
+        fec *coder;             /* the option fec, or NULL */
+
+        // receiver
+        packet_window<struct B_buffer> B_rcvpkt;
+        seqnum_t rcvbase;
+        seqnum_t lastack;
+        bool ack_pending;
+        int unacked;        /* packets taken since the last ACK went out */
+        bool acktimer;      /* the ACK timer is running */
+        message_queue unread;     /* delivered, not yet read by layer 5 */
+        int advertised;     /* the window in the last ACK */
+
+        // streams
+        std::vector<struct stream> streams;
+        int sendstream;     /* of the next message sent */
+    } side[2];
+
+    /* the options shared with gbn, see transport.h */
+    struct transport_options options;
+
+    /* the option sack, also on when ackevery is above 1 (as it is by */
+    /* default with ackdelay), as one ACK then answers several packets */
+    bool sack;
+
+    /* Time-based loss detection (RACK, RFC 8985), from the option rack=d */
+    /* (d the reordering window, min_rtt / 4 if no value).  The sender    */
+    /* logs every transmission.  The medium keeps order both ways, so     */
+    /* pure ACKs come back in the order the packets they answer went out, */
+    /* and each is matched with the first logged transmission of its      */
+    /* packet; that gives an RTT sample even for a retransmitted packet.  */
+    /* Once a packet sent later is known to have arrived, one still       */
+    /* unacked d past that packet's RTT is lost, and is resent at once;   */
+    /* one not yet that late is checked again on a timer.                 */
+    bool rack;
+    float reownd;
+
+    /* Streams, from the option streams=n (up to MAX_STREAMS): layer 5 */
+    /* messages go round-robin to n streams, which share the window.    */
+    /* The receiver delivers each stream in order as its packets come,  */
+    /* so a loss holds back only its own stream, not the whole window.  */
+    /* The window still advances past packets only in order.  Each      */
+    /* message's delay is sampled per stream, stream<i>_delay, and for  */
+    /* all of them, stream_delay (reverse_stream_delay from B to A).    */
+    int nstreams;
+    std::vector<std::string> stream_delay;  /* the series stream<i>_delay */
+
+    /* the numbered timers for ackdelay and the reader: timers 0.. are */
+    /* window slots                                                    */
+    int ack_timer(int AorB) const {
+        return side[AorB].A_sndpkt.capacity();
+    }
+
+    int read_timer(int AorB) const {
+        return side[AorB].A_sndpkt.capacity() + 1;
+    }
+
+    int rack_timer(int AorB) const {
+        return side[AorB].A_sndpkt.capacity() + 2;
+    }
+
+    int coalesce_timer(int AorB) const {
+        return side[AorB].A_sndpkt.capacity() + 3;
+    }
+
+    int rcvwindow(int AorB) const {
+        return std::max(0, options.rcvbuffer - (int) side[AorB].unread.size());
+    }
+
+    void deliver(int AorB, const char *payload, int length, msgid_t msgid);
+
+    void deliver_packet(int AorB, const struct pkt &packet);
+
+    void stream_input(int AorB, seqnum_t seqnum);
+
+    void deliver_stream(int AorB, int stream, const struct pkt &packet);
+
+    void read(int AorB);
+
+    void backpressure(int AorB);
+
+    simtime_t TimeoutInterval(int AorB);
+
+    /* packets that may be outstanding: -w, or less under the cc option */
+    /* or the other side's advertised window                            */
+    int window(int AorB) const {
+        const entity &e = side[AorB];
+        return std::max(1, std::min(std::min(e.N, e.cc->window()), e.rwnd));
+    }
+
+    /* Timer */
+
+    void output(int AorB, const struct msg &message);
+
+    void input(int AorB, const struct pkt &packet);
+
+    void timerinterrupt(int AorB, int slot);
+
+    void fast_retransmit(int AorB);
+
+    void transmit(int AorB, seqnum_t seq);
+
+    simtime_t answered(int AorB, seqnum_t seq);
+
+    void rack_update(int AorB, seqnum_t seq, simtime_t sent);
+
+    void detect_loss(int AorB);
+
+    void rack_retransmit(int AorB, seqnum_t seq);
+
+    void send(int AorB, const struct msg &message);
+
+    bool send_coalesced(int AorB);
+
+    void send_packet(int AorB);
+
+    void send_buffered(int AorB);
+
+    bool acknowledge(int AorB, seqnum_t seq, bool sample, simtime_t xmit = -1);
+
+    void send_ack(int AorB);
+
+    void pending_ack(int AorB, struct pkt *ack);
+
+    void init(int AorB);
 };
-static std::vector<B_buffer> B_rcvpkt(1100);
-static volatile int rcvbase = 1;
+
+sr::sr(struct simulation *sim)
+        : protocol(sim),
+          initial_rtt(10.0f), alpha(0.125f), beta(0.25f),
+          options(), sack(false), rack(false), reownd(-1), nstreams(0) {
+    for (int i = 0; i < 2; i++) {
+        entity &e = side[i];
+        e.SampleRTT = e.EstimatedRTT = initial_rtt;
+        e.DevRTT = 0.0f;
+        e.send_base = e.nextseqnum = 1;
+        e.N = 0;
+        e.cc = NULL;
+        e.rwnd = INT_MAX;
+        e.dupacks = 0;
+        e.recovering = false;
+        e.recover = 0;
+        e.rack_xmit = -1;
+        e.rack_seq = 0;
+        e.rack_rtt = 0;
+        e.min_rtt = DBL_MAX;
+        e.racktimer = false;
+        e.coalescetimer = false;
+        e.flush = false;
+        e.coder = NULL;
+        e.rcvbase = 1;
+        e.lastack = 0;
+        e.ack_pending = false;
+        e.unacked = 0;
+        e.acktimer = false;
+        e.advertised = INT_MAX;
+        e.sendstream = 0;
+    }
+}
 
 
+sr::~sr() {
+    delete side[0].cc;
+    delete side[1].cc;
+    delete side[0].coder;
+    delete side[1].coder;
+}
+
 /* called from layer 5, passed the data to be sent to other side */
-void A_output(struct msg message) {
-    if (nextseqnum < send_base + N) {
-        struct A_buffer b = {make_pkt(nextseqnum, 0, &message), false, false, get_sim_time()};
-        A_sndpkt[nextseqnum] = b;
-        DEBUG_A("Sending: " << A_sndpkt[nextseqnum].pkt);
-        tolayer3(0, A_sndpkt[nextseqnum].pkt);
-        start_timer(nextseqnum, TimeoutInterval());
-        nextseqnum++;
+void sr::A_send(const struct msg &message) {
+    output(0, message);
+}
+
+void sr::B_send(const struct msg &message) {
+    output(1, message);
+}
+
+void sr::output(int AorB, const struct msg &message) {
+    entity &e = side[AorB];
+    if (options.coalescing) {
+        e.A_buffer.push(message);
+        DEBUG_SIDE(AorB, "Buffered: " << message);
+        send_buffered(AorB);
+        return;
+    }
+    /* behind messages already waiting, it waits too, so layer 5's */
+    /* messages leave in the order they came                        */
+    if (e.A_buffer.empty() && seq_before(e.nextseqnum, e.send_base + window(AorB))) {
+        send(AorB, message);
     } else {
-        A_buffer.push(message);
-        DEBUG_A("Buffered: " << message);
+        e.A_buffer.push(message);
+        DEBUG_SIDE(AorB, "Buffered: " << message);
+    }
+    backpressure(AorB);
+}
+
+/* layer 5 may hand over another message while the window has room or */
+/* fewer than sendbuffer wait for it                                   */
+void sr::backpressure(int AorB) {
+    entity &e = side[AorB];
+    bool full = !seq_before(e.nextseqnum, e.send_base + window(AorB))
+                && (int) e.A_buffer.size() >= options.sendbuffer;
+    setbackpressure(sim, AorB, full);
+}
+
+/* send message as packet nextseqnum */
+void sr::send(int AorB, const struct msg &message) {
+    entity &e = side[AorB];
+    int ack = sack ? e.rcvbase - 1 : e.lastack;
+    if (nstreams == 0) {
+        make_pkt(&e.A_sndpkt[e.nextseqnum].pkt, e.nextseqnum, ack, &message, options.checksum);
+        send_packet(AorB);
+        return;
+    }
+    struct stream &st = e.streams[e.sendstream];
+    make_stream_pkt(&e.A_sndpkt[e.nextseqnum].pkt, e.nextseqnum, ack, e.sendstream, st.nextseq++, &message,
+                    options.checksum);
+    e.sendstream = (e.sendstream + 1) % nstreams;
+    send_packet(AorB);
+}
+
+/* send as many queued messages as fit as packet nextseqnum, unless */
+/* they leave it short and may still wait for more                  */
+bool sr::send_coalesced(int AorB) {
+    entity &e = side[AorB];
+    /* with fec, leave room for the parity packet's own header */
+    int room = getmtu(sim) - PKT_HEADER - (e.coder != NULL ? FEC_HEADER : 0);
+    int n = coalescible(e.A_buffer, room);   /* at least 1, see init() */
+    bool full = (unsigned long) n < e.A_buffer.size() || n == COALESCE_MAX;
+    if (!full && !e.flush && options.coalescedelay > 0) {
+        if (!e.coalescetimer) {
+            starttimer_id(sim, AorB, coalesce_timer(AorB), options.coalescedelay);
+            e.coalescetimer = true;
+        }
+        return false;
     }
+    struct pkt &p = e.A_sndpkt[e.nextseqnum].pkt;
+    p.seqnum = e.nextseqnum;
+    p.acknum = sack ? e.rcvbase - 1 : e.lastack;
+    p.length = coalesce(e.A_buffer, n, &p);
+    p.checksum = make_checksum(options.checksum, p);
+    sim_stat(sim, "coalesced", n);
+    if (e.A_buffer.empty()) {
+        e.flush = false;
+        if (e.coalescetimer) {
+            stoptimer_id(sim, AorB, coalesce_timer(AorB));
+            e.coalescetimer = false;
+        }
+    }
+    send_packet(AorB);
+    return true;
+}
+
+/* send packet nextseqnum, just filled in, carrying the last ACK */
+void sr::send_packet(int AorB) {
+    entity &e = side[AorB];
+    struct A_buffer &b = e.A_sndpkt[e.nextseqnum];
+    b.acked = false;
+    b.retransmitted = false;
+    DEBUG_SIDE(AorB, "Sending: " << b.pkt);
+    transmit(AorB, e.nextseqnum);
+    if (e.coder != NULL)
+        e.coder->sent(b.pkt);
+    if (e.ack_pending) {
+        e.ack_pending = false;
+        e.unacked = 0;
+        if (e.acktimer) {
+            stoptimer_id(sim, AorB, ack_timer(AorB));
+            e.acktimer = false;
+        }
+    }
+    starttimer_id(sim, AorB, e.A_sndpkt.slot(e.nextseqnum), TimeoutInterval(AorB));
+    e.nextseqnum++;
 }
 
 /* called from layer 3, when a packet arrives for layer 4 */
-void A_input(struct pkt packet) {
-    if (!is_corrupt(packet)) {
-        if (!A_sndpkt[packet.acknum].acked) {
-            cancel_timer(packet.acknum);
-            A_sndpkt[packet.acknum].acked = true;
-            DEBUG_A("\033[1;1m" << "Receive ACK: " << A_sndpkt[packet.acknum].pkt << "\033[0m");
-
-            if (!A_sndpkt[packet.acknum].retransmitted) {
-                SampleRTT = get_sim_time() - A_sndpkt[packet.acknum].sent_time;
-                EstimatedRTT = ((1 - alpha) * EstimatedRTT + (alpha * SampleRTT));
-                DevRTT = ((1 - beta) * DevRTT + (beta * fabsf(SampleRTT - EstimatedRTT)));
-            }
+void sr::A_receive(const struct pkt &packet) {
+    input(0, packet);
+}
+
+/* Note that with simplex transfer from a-to-B, there is no B_send() */
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void sr::B_receive(const struct pkt &packet) {
+    input(1, packet);
+}
 
-            if (packet.acknum == send_base) {
-                for (std::vector<std::pair<pkt, bool> >::size_type i = (unsigned long) (send_base);
-                     i != A_sndpkt.size() && A_sndpkt[i].acked; i++) {
-                    send_base++;
-                    DEBUG_A("Advancing send_base to: " << send_base);
+/* In simplex runs A only takes ACKs and B only takes data, as before. */
+void sr::input(int AorB, const struct pkt &packet) {
+    entity &e = side[AorB];
+    bool bidirectional = getbidirectional(sim);
+    if (e.coder != NULL && fec::is_parity(packet)) {
+        struct pkt rebuilt;
+        if (e.coder->recover(packet, &rebuilt)) {
+            DEBUG_SIDE(AorB, "\033[32;1m" << "Recovered: " << rebuilt << "\033[0m");
+            input(AorB, rebuilt);
+        } else {
+            DEBUG_SIDE(AorB, "Parity, nothing to recover: " << packet.seqnum);
+        }
+        return;
+    }
+    bool corrupt = is_corrupt(options.checksum, packet);
+    bool ack_now = false;
+    if (e.coder != NULL && !corrupt && has_data(packet))
+        e.coder->received(packet);
+
+    // receiver
+    if ((AorB == 1 || bidirectional) && (corrupt || has_data(packet))) {
+        seqnum_t seqnum = packet.seqnum;
+        if (!corrupt) {
+            if (seq_between(e.rcvbase, seqnum, e.rcvbase + std::min(e.N, rcvwindow(AorB)))) {
+                e.lastack = seqnum;
+                e.ack_pending = true;
+                e.unacked++;
+                ack_now = options.ackoutoforder && (seqnum != e.rcvbase || e.B_rcvpkt[seqnum].acked);
+
+                if (nstreams > 0) {
+                    /* delivered by stream; the window then moves past */
+                    /* whatever has arrived in order                    */
+                    if (!e.B_rcvpkt[seqnum].acked) {
+                        copy_pkt(&e.B_rcvpkt[seqnum].pkt, packet);
+                        e.B_rcvpkt[seqnum].acked = true;
+                        stream_input(AorB, seqnum);
+                    }
+                    while (e.B_rcvpkt[e.rcvbase].acked) {
+                        e.B_rcvpkt[e.rcvbase].acked = false;
+                        e.rcvbase++;
+                        DEBUG_SIDE(AorB, "Advancing rcvbase to: " << e.rcvbase);
+                    }
+                } else if (seqnum == e.rcvbase) {
+                    /* in order: read where it arrived, then whatever */
+                    /* was waiting for it                              */
+                    DEBUG_SIDE(AorB, "\033[32;1m" << "Received: " << packet << "\033[0m");
+                    deliver_packet(AorB, packet);
+                    e.rcvbase++;
+                    DEBUG_SIDE(AorB, "Advancing rcvbase to: " << e.rcvbase);
+                    while (e.B_rcvpkt[e.rcvbase].acked) {
+                        DEBUG_SIDE(AorB, "\033[32;1m" << "Received: " << e.B_rcvpkt[e.rcvbase].pkt << "\033[0m");
+                        deliver_packet(AorB, e.B_rcvpkt[e.rcvbase].pkt);
+                        e.B_rcvpkt[e.rcvbase].acked = false;   /* free the slot for rcvbase + N */
+                        e.rcvbase++;
+                        DEBUG_SIDE(AorB, "Advancing rcvbase to: " << e.rcvbase);
+                    }
+                } else if (!e.B_rcvpkt[seqnum].acked) {
+                    copy_pkt(&e.B_rcvpkt[seqnum].pkt, packet);
+                    e.B_rcvpkt[seqnum].acked = true;
                 }
-                send_buffered();
+
+            } else if (seq_between(e.rcvbase - e.N, seqnum, e.rcvbase)) {
+                DEBUG_SIDE(AorB, "Sending DUP-ACK: " << seqnum);
+                e.lastack = seqnum;
+                e.ack_pending = true;
+                e.unacked++;
+                ack_now = options.ackoutoforder;
             }
         } else {
-            DEBUG_A("Receive DUP-ACK: " << packet);
+            DEBUG_SIDE(AorB, "Receive CORRUPT pkt, ignoring: " << packet);
         }
-    } else {
+    }
+
+    // sender
+    if ((AorB == 0 || bidirectional) && !corrupt) {
+        seqnum_t acknum = packet.acknum, base = e.send_base;
+        simtime_t xmit = -1;
+        bool fresh;
+        bool opened = false;    /* the advertised window grew */
+        if (!has_data(packet)) {
+            opened = get_rwnd(packet) > e.rwnd;
+            e.rwnd = get_rwnd(packet);
+            if (rack)
+                xmit = answered(AorB, sack ? packet.seqnum : packet.acknum);
+        }
+        if (!sack) {
+            fresh = acknowledge(AorB, acknum, true, xmit);
+        } else {
+            /* one pass over the cumulative range and the bitmap */
+            fresh = false;
+            for (seqnum_t seq = e.send_base; seq_between(e.send_base, seq, e.nextseqnum)
+                                             && !seq_before(acknum, seq); seq++)
+                fresh |= seq == (seqnum_t) packet.seqnum && !has_data(packet)
+                         ? acknowledge(AorB, seq, true, xmit) : acknowledge(AorB, seq, false);
+            if (!has_data(packet)) {
+                fresh |= acknowledge(AorB, packet.seqnum, true, xmit);
+                for (int i = 0; i < SACK_BITS; i++)
+                    if (packet.payload[SACK_OFFSET + i / 8] & (1 << (i % 8)))
+                        fresh |= acknowledge(AorB, acknum + 2 + i, false);
+            }
+        }
+
+        if (fresh && e.A_sndpkt[base].acked) {
+            while (e.send_base != e.nextseqnum && e.A_sndpkt[e.send_base].acked) {
+                e.send_base++;
+                DEBUG_SIDE(AorB, "Advancing send_base to: " << e.send_base);
+            }
+            e.dupacks = 0;
+            if (e.recovering) {
+                /* the channel keeps order, so what is still unacked up */
+                /* to recover was lost along with the old send_base     */
+                e.recovering = (options.fastrecovery || rack)
+                               && seq_between(e.send_base, e.recover, e.nextseqnum);
+                if (e.recovering && options.fastrecovery)
+                    fast_retransmit(AorB);
+            }
+            while (!e.sent.empty() && seq_before(e.sent.front().first, e.send_base))
+                e.sent.pop_front();
+            if (rack)
+                detect_loss(AorB);
+        } else if (fresh) {
+            if (options.dupthresh > 0 && ++e.dupacks == options.dupthresh && !e.recovering) {
+                e.recovering = true;
+                e.recover = e.nextseqnum - 1;
+                e.cc->lost();
+                fast_retransmit(AorB);
+            }
+            if (rack)
+                detect_loss(AorB);
+        } else {
+            DEBUG_SIDE(AorB, "Receive DUP-ACK: " << packet);
+        }
+        /* the window moved or grew: waiting messages may go */
+        if (fresh || opened)
+            send_buffered(AorB);
+    } else if (AorB == 0 && corrupt) {
         DEBUG_A("Receive CORRUPT ACK: " << packet);
     }
+
+    if (e.ack_pending) {
+        if (ack_now || e.unacked >= options.ackevery) {
+            send_ack(AorB);
+        } else if (options.ackdelay > 0 && !e.acktimer) {
+            starttimer_id(sim, AorB, ack_timer(AorB), options.ackdelay);
+            e.acktimer = true;
+        }
+    }
 }
 
-void send_buffered() {
-    while (!A_buffer.empty() && nextseqnum < send_base + N) {
-        struct msg message = A_buffer.front();
-        struct A_buffer b = {make_pkt(nextseqnum, 0, &message), false, false, get_sim_time()};
-        A_sndpkt[nextseqnum] = b;
-        DEBUG_A("Sending buffered: " << A_sndpkt[nextseqnum].pkt);
-        tolayer3(0, A_sndpkt[nextseqnum].pkt);
-        start_timer(nextseqnum, TimeoutInterval());
-        nextseqnum++;
-        A_buffer.pop();
+void sr::send_ack(int AorB) {
+    entity &e = side[AorB];
+    e.advertised = rcvwindow(AorB);
+    struct pkt *ack = newpacket(sim);
+    pending_ack(AorB, ack);
+    DEBUG_SIDE(AorB, "Sending ACK: " << *ack);
+    sendpacket(sim, AorB, ack);
+    sim_stat(sim, "ack", e.unacked);
+    e.ack_pending = false;
+    e.unacked = 0;
+    if (e.acktimer) {
+        stoptimer_id(sim, AorB, ack_timer(AorB));
+        e.acktimer = false;
     }
 }
 
-/* called when A's timer goes off */
-void A_timerinterrupt() {
-    starttimer(0, CLOCK_TICK);
-    while (!timers.empty()) {
-        timer t = timers.top();
-        if (t.time <= get_sim_time()) {
-            if (!cancelled_timers.count(t.seq)) {
-                DEBUG_A("\033[31;1m" << "TIMEOUT Re-Sending: " << A_sndpkt[t.seq].pkt << "\033[0m");
-                tolayer3(0, A_sndpkt[t.seq].pkt);
-                A_sndpkt[t.seq].retransmitted = true;
-                start_timer(t.seq, TimeoutInterval() * 2);
-            } else {
-//                DEBUG_A("\033[31;1m" << "TIMEOUT Cancelled: " << t << "\033[0m");
-            }
-            timers.pop();
-        } else {
-//            DEBUG_A("\033[31;1m" << "TIMEOUT BREAK: " << t << "\033[0m");
-            break;
+/* mark packet seq acknowledged, stopping its timer and, with sample, */
+/* taking an RTT sample; false unless it was outstanding and unacked.  */
+/* xmit is the transmission the ACK answers, if known; otherwise only  */
+/* a packet sent once gives a sample (Karn's rule).                    */
+bool sr::acknowledge(int AorB, seqnum_t seq, bool sample, simtime_t xmit) {
+    entity &e = side[AorB];
+    if (!seq_between(e.send_base, seq, e.nextseqnum) || e.A_sndpkt[seq].acked)
+        return false;
+    stoptimer_id(sim, AorB, e.A_sndpkt.slot(seq));
+    e.A_sndpkt[seq].acked = true;
+    e.cc->acked(1);
+    DEBUG_SIDE(AorB, "\033[1;1m" << "Receive ACK: " << e.A_sndpkt[seq].pkt << "\033[0m");
+
+    simtime_t sent = xmit >= 0 ? xmit : e.A_sndpkt[seq].retransmitted ? -1 : e.A_sndpkt[seq].sent_time;
+    if (sample && sent >= 0) {
+        e.SampleRTT = get_sim_time(sim) - sent;
+        e.EstimatedRTT = ((1 - alpha) * e.EstimatedRTT + (alpha * e.SampleRTT));
+        e.DevRTT = ((1 - beta) * e.DevRTT + (beta * fabs(e.SampleRTT - e.EstimatedRTT)));
+        sim_stat(sim, "rtt_sample", e.SampleRTT);
+    }
+    if (rack && sent >= 0)
+        rack_update(AorB, seq, sent);
+    return true;
+}
+
+/* put packet seq on the medium, noting when */
+void sr::transmit(int AorB, seqnum_t seq) {
+    entity &e = side[AorB];
+    tolayer3(sim, AorB, e.A_sndpkt[seq].pkt);
+    e.A_sndpkt[seq].sent_time = get_sim_time(sim);
+    if (rack)
+        e.sent.push_back(std::make_pair(seq, get_sim_time(sim)));
+}
+
+/* When the transmission of seq that a pure ACK answers was sent, the */
+/* ones logged before it having drawn no ACK.  Of several in the log,  */
+/* that is the last sent min_rtt or more ago (RFC 8985): an ACK cannot */
+/* be quicker, and taking an earlier one when it was lost would stretch */
+/* the RTT by a timeout or more.  Until there is a min_rtt it is the   */
+/* first: timeouts shorter than the RTT, which leave no packet sent    */
+/* only once, resend packets whose ACK is on its way.  -1 if there is  */
+/* no transmission, e.g. for a window update repeating an earlier ACK. */
+simtime_t sr::answered(int AorB, seqnum_t seq) {
+    entity &e = side[AorB];
+    simtime_t now = get_sim_time(sim);
+    long first = -1, last = -1;
+    int count = 0;
+    for (unsigned long i = 0; i < e.sent.size(); i++)
+        if (e.sent[i].first == seq) {
+            if (count++ == 0)
+                first = i;
+            if (now - e.sent[i].second >= e.min_rtt)
+                last = i;
         }
+    if (count == 0)
+        return -1;
+    if (count == 1 || e.min_rtt == DBL_MAX)
+        last = first;
+    else if (last < 0)
+        return -1;
+    simtime_t xmit = e.sent[last].second;
+    e.sent.erase(e.sent.begin(), e.sent.begin() + last + 1);
+    return xmit;
+}
+
+/* packet seq, sent at the given time, has arrived */
+void sr::rack_update(int AorB, seqnum_t seq, simtime_t sent) {
+    entity &e = side[AorB];
+    simtime_t rtt = get_sim_time(sim) - sent;
+    e.min_rtt = std::min(e.min_rtt, rtt);
+    if (sent > e.rack_xmit || (sent == e.rack_xmit && seq_before(e.rack_seq, seq))) {
+        e.rack_xmit = sent;
+        e.rack_seq = seq;
+        e.rack_rtt = rtt;
     }
 }
 
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init() {
-    N = getwinsize();
-    starttimer(0, CLOCK_TICK);
+/* resend every unacked packet last sent before the last transmission */
+/* known to have arrived, and late by more than the reordering window; */
+/* wait on the RACK timer for the first of the rest to become that late */
+void sr::detect_loss(int AorB) {
+    entity &e = side[AorB];
+    simtime_t now = get_sim_time(sim);
+    simtime_t reo = reownd >= 0 ? reownd : e.min_rtt < DBL_MAX ? e.min_rtt / 4 : 0;
+    simtime_t wait = 0;
+    for (seqnum_t seq = e.send_base; seq != e.nextseqnum; seq++) {
+        const struct A_buffer &b = e.A_sndpkt[seq];
+        if (b.acked || b.sent_time > e.rack_xmit || (b.sent_time == e.rack_xmit && !seq_before(seq, e.rack_seq)))
+            continue;
+        simtime_t remaining = b.sent_time + e.rack_rtt + reo - now;
+        if (remaining <= 0)
+            rack_retransmit(AorB, seq);
+        else if (wait == 0 || remaining < wait)
+            wait = remaining;
+    }
+    if (e.racktimer)
+        stoptimer_id(sim, AorB, rack_timer(AorB));
+    e.racktimer = wait > 0;
+    if (e.racktimer)
+        starttimer_id(sim, AorB, rack_timer(AorB), wait);
 }
 
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
+/* as fast_retransmit, for any packet; one window decrease for the */
+/* losses up to recover                                            */
+void sr::rack_retransmit(int AorB, seqnum_t seq) {
+    entity &e = side[AorB];
+    struct A_buffer &b = e.A_sndpkt[seq];
+    sim_stat(sim, "rack_retransmit", 1);
+    if (!e.recovering) {
+        e.recovering = true;
+        e.recover = e.nextseqnum - 1;
+        e.cc->lost();
+    }
+    DEBUG_SIDE(AorB, "\033[31;1m" << "RACK Re-Sending: " << b.pkt << "\033[0m");
+    transmit(AorB, seq);
+    b.retransmitted = true;
+    stoptimer_id(sim, AorB, e.A_sndpkt.slot(seq));
+    starttimer_id(sim, AorB, e.A_sndpkt.slot(seq), TimeoutInterval(AorB));
+}
 
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet) {
-    if (!is_corrupt(packet)) {
-        if (packet.seqnum >= rcvbase && packet.seqnum < rcvbase + N) {
-            struct pkt ack = make_ack(packet.seqnum);
-            DEBUG_B("Sending ACK: " << ack);
-            tolayer3(1, ack);
-
-            if (!B_rcvpkt[packet.seqnum].acked) {
-                struct B_buffer b = {packet, true};
-                B_rcvpkt[packet.seqnum] = b;
-            }
+/* the ACK for the packet the receiver took last, filled in in place */
+void sr::pending_ack(int AorB, struct pkt *ack) {
+    entity &e = side[AorB];
+    if (!sack) {
+        make_ack(ack, e.lastack, e.advertised, options.checksum);
+        return;
+    }
 
-            if (packet.seqnum == rcvbase) {
-                for (std::vector<B_buffer>::size_type i = (unsigned long) (rcvbase);
-                     i != B_rcvpkt.size() && B_rcvpkt[i].acked; i++) {
-                    DEBUG_B("\033[32;1m" << "Received: " << B_rcvpkt[i].pkt << "\033[0m");
-                    tolayer5(1, B_rcvpkt[i].pkt.payload);
-                    rcvbase++;
-                    DEBUG_A("Advancing rcvbase to: " << rcvbase);
-                }
-            }
+    unsigned char bitmap[SACK_BITS / 8] = {0};
+    for (int i = 0; i < SACK_BITS && i + 1 < e.N; i++)
+        if (e.B_rcvpkt[e.rcvbase + 1 + i].acked)
+            bitmap[i / 8] |= 1 << (i % 8);
+    make_sack(ack, e.lastack, e.rcvbase - 1, e.advertised, bitmap, options.checksum);
+}
 
-        } else if (packet.seqnum >= rcvbase - N && packet.seqnum < rcvbase) {
-            struct pkt ack = make_ack(packet.seqnum);
-            DEBUG_B("Sending DUP-ACK: " << ack);
-            tolayer3(1, ack);
+void sr::send_buffered(int AorB) {
+    entity &e = side[AorB];
+    while (!e.A_buffer.empty() && seq_before(e.nextseqnum, e.send_base + window(AorB))) {
+        if (options.coalescing) {
+            if (!send_coalesced(AorB))
+                break;
+            continue;
         }
-    } else {
-        DEBUG_B("Receive CORRUPT pkt, ignoring: " << packet);
+        send(AorB, e.A_buffer.front());
+        e.A_buffer.pop();
     }
+    backpressure(AorB);
+}
+
+/* in-order data for layer 5, read at once or, with readdelay, queued */
+/* for the reader                                                     */
+void sr::deliver(int AorB, const char *payload, int length, msgid_t msgid) {
+    entity &e = side[AorB];
+    if (options.readdelay <= 0) {
+        tolayer5(sim, AorB, payload, length, msgid);
+        return;
+    }
+    struct msg message;
+    message.length = length;
+    message.msgid = msgid;
+    memcpy(message.data, payload, length);
+    e.unread.push(message);
+    if (e.unread.size() == 1)
+        starttimer_id(sim, AorB, read_timer(AorB), options.readdelay);
+}
+
+/* each message of an in-order packet */
+void sr::deliver_packet(int AorB, const struct pkt &packet) {
+    if (!options.coalescing) {
+        deliver(AorB, packet.payload, packet.length, packet.msgid);
+        return;
+    }
+    coalesced_messages messages(packet);
+    const char *data;
+    int length;
+    msgid_t msgid;
+    while (messages.next(&data, &length, &msgid))
+        deliver(AorB, data, length, msgid);
+}
+
+/* Delivers packet seqnum, just taken, if its stream expects it, and */
+/* then those of the stream that waited for it; else it waits too.   */
+/* The window cannot move past a waiting packet: the one its stream  */
+/* expects was sent before it and has not arrived.                   */
+void sr::stream_input(int AorB, seqnum_t seqnum) {
+    entity &e = side[AorB];
+    const struct pkt &packet = e.B_rcvpkt[seqnum].pkt;
+    int s = get_stream(packet);
+    if (s < 0 || s >= nstreams) {
+        DEBUG_SIDE(AorB, "Unknown stream, ignoring: " << packet);
+        return;
+    }
+    struct stream &st = e.streams[s];
+    seqnum_t streamseq = get_streamseq(packet);
+    if (streamseq != st.expected) {
+        DEBUG_SIDE(AorB, "Stream " << s << " waits for " << st.expected << ": " << packet);
+        st.held[streamseq].held = true;
+        st.held[streamseq].seqnum = seqnum;
+        return;
+    }
+    deliver_stream(AorB, s, packet);
+    while (st.held[st.expected].held) {
+        struct B_held &next = st.held[st.expected];
+        next.held = false;
+        deliver_stream(AorB, s, e.B_rcvpkt[next.seqnum].pkt);
+    }
+}
+
+/* the next message of stream, and its delay since the other side's */
+/* layer 5 handed it down                                           */
+void sr::deliver_stream(int AorB, int stream, const struct pkt &packet) {
+    struct stream &st = side[AorB].streams[stream];
+    DEBUG_SIDE(AorB, "\033[32;1m" << "Received on stream " << stream << ": " << packet << "\033[0m");
+    st.expected++;
+    simtime_t delay = get_msg_age(sim, AorB, packet.msgid);
+    if (delay >= 0) {
+        if (AorB == 1) {
+            sim_distribution(sim, "stream_delay", delay);
+            sim_distribution(sim, stream_delay[stream].c_str(), delay);
+        } else {
+            sim_distribution(sim, "reverse_stream_delay", delay);
+        }
+    }
+    deliver(AorB, packet.payload + STREAM_HEADER, packet.length - STREAM_HEADER, packet.msgid);
+}
+
+/* layer 5 reads one message; a window that had closed is reopened */
+/* with an ACK at once                                            */
+void sr::read(int AorB) {
+    entity &e = side[AorB];
+    tolayer5(sim, AorB, e.unread.front().data, e.unread.front().length, e.unread.front().msgid);
+    e.unread.pop();
+    if (!e.unread.empty())
+        starttimer_id(sim, AorB, read_timer(AorB), options.readdelay);
+    if (e.advertised == 0) {
+        DEBUG_SIDE(AorB, "Window update: " << rcvwindow(AorB));
+        send_ack(AorB);
+    }
+}
+
+/* called when A's timer goes off */
+void sr::A_timerinterrupt() {
+}
+
+/* called when the timer of the packet in window slot goes off */
+void sr::A_timerinterrupt_id(int slot) {
+    timerinterrupt(0, slot);
+}
+
+void sr::B_timerinterrupt_id(int slot) {
+    timerinterrupt(1, slot);
+}
+
+void sr::timerinterrupt(int AorB, int slot) {
+    if (slot == read_timer(AorB)) {
+        read(AorB);
+        return;
+    }
+    if (slot == ack_timer(AorB)) {
+        side[AorB].acktimer = false;
+        send_ack(AorB);
+        return;
+    }
+    if (slot == rack_timer(AorB)) {
+        side[AorB].racktimer = false;
+        detect_loss(AorB);
+        return;
+    }
+    if (slot == coalesce_timer(AorB)) {
+        side[AorB].coalescetimer = false;
+        side[AorB].flush = true;
+        send_buffered(AorB);
+        return;
+    }
+    entity &e = side[AorB];
+    struct A_buffer &b = e.A_sndpkt[slot];
+    sim_stat(sim, "timeout", 1);
+    if ((unsigned int) slot == e.A_sndpkt.slot(e.send_base)) {
+        /* one window decrease for the timeouts of a whole window */
+        e.dupacks = 0;
+        e.recovering = false;
+        e.cc->timeout();
+    }
+    DEBUG_SIDE(AorB, "\033[31;1m" << "TIMEOUT Re-Sending: " << b.pkt << "\033[0m");
+    transmit(AorB, b.pkt.seqnum);
+    b.retransmitted = true;
+    starttimer_id(sim, AorB, slot, TimeoutInterval(AorB) * 2);
+}
+
+/* Packets ACKed past send_base (or, in recovery, a send_base short of */
+/* recover) mean it was lost: resend it now rather than at its timeout, */
+/* with the timer restarted but not backed off.                        */
+void sr::fast_retransmit(int AorB) {
+    entity &e = side[AorB];
+    struct A_buffer &b = e.A_sndpkt[e.send_base];
+    sim_stat(sim, "fast_retransmit", 1);
+    DEBUG_SIDE(AorB, "\033[31;1m" << "FAST Re-Sending: " << b.pkt << "\033[0m");
+    transmit(AorB, e.send_base);
+    b.retransmitted = true;
+    stoptimer_id(sim, AorB, e.A_sndpkt.slot(e.send_base));
+    starttimer_id(sim, AorB, e.A_sndpkt.slot(e.send_base), TimeoutInterval(AorB));
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+void sr::A_init() {
+    init(0);
 }
 
 /* the following rouytine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init() {
+void sr::B_init() {
+    init(1);
+}
 
+void sr::init(int AorB) {
+    entity &e = side[AorB];
+    if (!get_transport_options(sim, &options))
+        return;
+    sack = getoption(sim, "sack") != NULL || options.ackevery > 1;
+    e.N = getwinsize(sim);
+    e.A_sndpkt.resize(e.N, getmtu(sim));
+    e.B_rcvpkt.resize(e.N, getmtu(sim));
+    rack = getoption(sim, "rack") != NULL;
+    reownd = getoption(sim, "rack", -1);
+    e.cc = make_congestion_control(options.cc, sim, AorB, e.N);
+    if (e.cc == NULL) {
+        sim_error(sim, "Unknown congestion control: %s", options.cc);
+        return;
+    }
+    if (getoption(sim, "streams") != NULL) {
+        nstreams = (int) getoption(sim, "streams", 1);
+        if (nstreams < 1 || nstreams > MAX_STREAMS) {
+            sim_error(sim, "Need 1 <= streams <= %d", MAX_STREAMS);
+            return;
+        }
+        if (options.coalescing) {
+            sim_error(sim, "Streams do not combine with coalesce");
+            return;
+        }
+        if (PKT_HEADER + STREAM_HEADER + getmaxmsgsize(sim) > getmtu(sim)) {
+            sim_error(sim, "Messages of %d bytes need an MTU of %d with streams", getmaxmsgsize(sim),
+                      PKT_HEADER + STREAM_HEADER + getmaxmsgsize(sim));
+            return;
+        }
+        stream_delay.resize(nstreams);
+        for (int i = 0; i < nstreams; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "stream%d_delay", i);
+            stream_delay[i] = name;
+        }
+    }
+    if (!transport_fits_mtu(sim, options, getmaxmsgsize(sim) + (nstreams > 0 ? STREAM_HEADER : 0)))
+        return;
+    if (options.feck > 0)
+        e.coder = new fec(sim, AorB, options.feck, options.fecm, options.checksum);
+    e.streams.resize(nstreams);
+    for (int i = 0; i < nstreams; i++) {
+        e.streams[i].nextseq = e.streams[i].expected = 0;
+        e.streams[i].held.resize(e.N);
+    }
 }
 
-float TimeoutInterval() {
-    float TimeoutInterval = EstimatedRTT + 4 * DevRTT;
-    DEBUG_A("Estimated TimeoutInterval: " << TimeoutInterval);
+simtime_t sr::TimeoutInterval(int AorB) {
+    simtime_t TimeoutInterval = side[AorB].EstimatedRTT + 4 * side[AorB].DevRTT;
+    DEBUG_SIDE(AorB, "Estimated TimeoutInterval: " << TimeoutInterval);
+    sim_stat(sim, "rto", TimeoutInterval);
     return TimeoutInterval;
 }
 
 
-pkt make_pkt(int seq, int ack, const struct msg *msg) {
-    struct pkt pkt = {seq, ack};
+/* packets are filled in where they lie: in the window, or in the */
+/* event that carries them (see newpacket())                        */
+static void make_pkt(struct pkt *pkt, int seq, int ack, const struct msg *msg, enum checksum_type checksum) {
+    pkt->seqnum = seq;
+    pkt->acknum = ack;
     if (msg != NULL) {
-        memcpy(pkt.payload, (*msg).data, 20);
+        pkt->length = (*msg).length;
+        pkt->msgid = (*msg).msgid;
+        memcpy(pkt->payload, (*msg).data, pkt->length);
+    } else {
+        pkt->length = 1;
+        pkt->payload[0] = '\0';
     }
-    pkt.checksum = make_checksum(pkt);
-    return pkt;
+    pkt->checksum = make_checksum(checksum, *pkt);
 }
 
-int make_checksum(const struct pkt &pkt) {
-    int checksum = 0;
-    checksum += pkt.seqnum;
-    checksum += pkt.acknum;
-    for (int i = 0; i < 20; ++i) {
-        checksum += pkt.payload[i];
-    }
-    return checksum;
+/* the advertised window travels in payload[1..2], after the 0 that */
+/* marks an ACK                                                     */
+static void set_rwnd(struct pkt &pkt, int rwnd) {
+    rwnd = std::min(rwnd, 0xffff);
+    pkt.payload[1] = (char) (rwnd & 0xff);
+    pkt.payload[2] = (char) (rwnd >> 8);
+}
+
+static int get_rwnd(const struct pkt &pkt) {
+    return (unsigned char) pkt.payload[1] | (unsigned char) pkt.payload[2] << 8;
+}
+
+static void make_ack(struct pkt *pkt, int ack, int rwnd, enum checksum_type checksum) {
+    pkt->seqnum = 0;
+    pkt->acknum = ack;
+    pkt->length = 3;
+    memset(pkt->payload, 0, pkt->length);
+    set_rwnd(*pkt, rwnd);
+    pkt->checksum = make_checksum(checksum, *pkt);
 }
 
+static void make_sack(struct pkt *pkt, int seq, int ack, int rwnd, const unsigned char *bitmap,
+                      enum checksum_type checksum) {
+    pkt->seqnum = seq;
+    pkt->acknum = ack;
+    pkt->length = SACK_OFFSET + SACK_BITS / 8;
+    memset(pkt->payload, 0, pkt->length);
+    set_rwnd(*pkt, rwnd);
+    memcpy(pkt->payload + SACK_OFFSET, bitmap, SACK_BITS / 8);
+    pkt->checksum = make_checksum(checksum, *pkt);
+}
+
+static void make_stream_pkt(struct pkt *pkt, int seq, int ack, int stream, int streamseq,
+                            const struct msg *msg, enum checksum_type checksum) {
+    pkt->seqnum = seq;
+    pkt->acknum = ack;
+    pkt->length = STREAM_HEADER + msg->length;
+    pkt->msgid = msg->msgid;
+    pkt->payload[0] = (char) (stream + 1);
+    pkt->payload[1] = (char) (streamseq & 0xff);
+    pkt->payload[2] = (char) ((streamseq >> 8) & 0xff);
+    memcpy(pkt->payload + STREAM_HEADER, msg->data, msg->length);
+    pkt->checksum = make_checksum(checksum, *pkt);
+}
 
-bool is_corrupt(const struct pkt &pkt) {
-    return make_checksum(pkt) != pkt.checksum;
+static int get_stream(const struct pkt &pkt) {
+    return (unsigned char) pkt.payload[0] - 1;
 }
 
-pkt make_ack(int ack) {
-    return make_pkt(0, ack, NULL);
+static seqnum_t get_streamseq(const struct pkt &pkt) {
+    return (unsigned char) pkt.payload[1] | (unsigned char) pkt.payload[2] << 8;
 }
 
-std::ostream &operator<<(std::ostream &os, const msg &m) {
-    return os << "{msg: " << std::string(m.data, 20) << '}';
+/* ACKs carry no payload; layer 5 never hands down a message starting with '\0' */
+static bool has_data(const struct pkt &pkt) {
+    return pkt.payload[0] != '\0';
 }
 
-std::ostream &operator<<(std::ostream &os, const pkt &p) {
+static std::ostream &operator<<(std::ostream &os, const msg &m) {
+    return os << "{msg: " << std::string(m.data, m.length) << '}';
+}
+
+static std::ostream &operator<<(std::ostream &os, const pkt &p) {
     os << "{seq: " << p.seqnum << ", ack:" << p.acknum << ", chks:" << p.checksum;
     if (p.payload[0] != '\0') {
-        os << ", payload:" << std::string(p.payload, 20);
+        os << ", payload:" << std::string(p.payload, p.length);
     }
     os << '}';
     return os;
 }
 
-void start_timer(int seq, float time) {
-    timer t = {seq, time + get_sim_time()};
-    timers.push(t);
+static protocol *make_sr(struct simulation *sim) {
+    return new sr(sim);
 }
 
-void cancel_timer(int seq) {
-    if (!cancelled_timers.count(seq)) {
-        cancelled_timers.insert(seq);
-    }
-}
\ No newline at end of file
+static protocol_registration registration("sr", make_sr);
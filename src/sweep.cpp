@@ -0,0 +1,469 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../include/simulator.h"
+
+/*
+ * Parameter sweep: runs every point of a protocol x seed x stream x window x
+ * messages x loss x corruption x interval x message size grid as an independent simulation
+ * on a pool of threads, and writes one CSV or JSON row per run.  Runs that
+ * share a seed but not a stream draw from non-overlapping parts of the
+ * xoshiro sequence.
+ */
+
+struct run {
+    std::string protocol;
+    struct sim_params params;
+    struct sim_results results;
+    double wall;               /* seconds spent running it */
+};
+
+/* A worker takes runs from the back of its own deque and, when that is */
+/* empty, steals from the front of the others.                          */
+struct task_deque {
+    pthread_mutex_t lock;
+    std::deque<unsigned long> tasks;
+};
+
+static std::vector<run> runs;
+static std::vector<task_deque> deques;
+static const char *queue = "heap";
+static const char *generator = "xoshiro";
+static int bidirectional = 0;
+static const char *layer5 = NULL;
+static int mtu = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool take(unsigned long victim, bool own, unsigned long *task) {
+    task_deque &d = deques[victim];
+    bool found = false;
+    pthread_mutex_lock(&d.lock);
+    if (!d.tasks.empty()) {
+        if (own) {
+            *task = d.tasks.back();
+            d.tasks.pop_back();
+        } else {
+            *task = d.tasks.front();
+            d.tasks.pop_front();
+        }
+        found = true;
+    }
+    pthread_mutex_unlock(&d.lock);
+    return found;
+}
+
+/* No runs are added once the workers start, so a full pass over every */
+/* deque that finds nothing means the sweep is done.                   */
+static bool next_task(unsigned long self, unsigned long *task) {
+    unsigned long n = deques.size();
+    if (take(self, true, task))
+        return true;
+    for (unsigned long k = 1; k < n; k++)
+        if (take((self + k) % n, false, task))
+            return true;
+    return false;
+}
+
+static void *worker(void *arg) {
+    unsigned long self = (unsigned long) arg, task;
+    while (next_task(self, &task)) {
+        run &r = runs[task];
+        double start = now();
+        struct simulation *sim = sim_create(&r.params, find_protocol(r.protocol.c_str()), &r.results.error);
+        if (sim != NULL) {
+            sim_run(sim);
+            sim_results(sim, &r.results);
+            sim_destroy(sim);
+        } else {
+            r.results.mtu = r.params.mtu;
+        }
+        r.wall = now() - start;
+    }
+    return NULL;
+}
+
+/* "a,b,c" or a range "first:last[:step]" */
+static std::vector<double> parse_list(const char *spec, char opt) {
+    std::vector<double> values;
+    std::string s(spec);
+    if (s.find(':') != std::string::npos) {
+        double first, last, step = 1;
+        int n = sscanf(spec, "%lf:%lf:%lf", &first, &last, &step);
+        if (n < 2 || step <= 0 || last < first) {
+            fprintf(stderr, "Invalid range for -%c\n", opt);
+            exit(-1);
+        }
+        for (long i = 0; first + i * step <= last + step * 1e-9; i++)
+            values.push_back(first + i * step);
+        return values;
+    }
+    for (std::string::size_type pos = 0; pos <= s.size();) {
+        std::string::size_type end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        char *rest;
+        double v = strtod(item.c_str(), &rest);
+        if (item.empty() || *rest != '\0') {
+            fprintf(stderr, "Invalid value for -%c\n", opt);
+            exit(-1);
+        }
+        values.push_back(v);
+        pos = end + 1;
+    }
+    return values;
+}
+
+/* option sets separated by ';', each "name[=value],..." as for -P of abt/gbn/sr */
+static std::vector<std::string> parse_option_sets(const char *spec) {
+    std::vector<std::string> sets;
+    std::string s(spec);
+    for (std::string::size_type pos = 0; pos <= s.size();) {
+        std::string::size_type end = s.find(';', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        sets.push_back(s.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return sets;
+}
+
+static std::vector<std::string> parse_names(const char *spec) {
+    std::vector<std::string> names;
+    std::string s(spec);
+    for (std::string::size_type pos = 0; pos <= s.size();) {
+        std::string::size_type end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string name = s.substr(pos, end - pos);
+        if (find_protocol(name.c_str()) == NULL) {
+            fprintf(stderr, "Unknown protocol: %s\n", name.c_str());
+            exit(-1);
+        }
+        names.push_back(name);
+        pos = end + 1;
+    }
+    return names;
+}
+
+/* the protocol statistics series of any run, in order of appearance */
+static std::vector<std::string> series_names() {
+    std::vector<std::string> names;
+    for (unsigned long i = 0; i < runs.size(); i++)
+        for (unsigned long k = 0; k < runs[i].results.stats.size(); k++)
+            if (std::find(names.begin(), names.end(), runs[i].results.stats[k].name) == names.end())
+                names.push_back(runs[i].results.stats[k].name);
+    return names;
+}
+
+static const struct sim_series *find_series(const run &r, const std::string &name) {
+    for (unsigned long k = 0; k < r.results.stats.size(); k++)
+        if (name == r.results.stats[k].name)
+            return &r.results.stats[k];
+    return NULL;
+}
+
+/* whether any run keeps the distribution of the series name */
+static bool has_percentiles(const std::string &name) {
+    for (unsigned long i = 0; i < runs.size(); i++) {
+        const struct sim_series *st = find_series(runs[i], name);
+        if (st != NULL && st->has_percentiles())
+            return true;
+    }
+    return false;
+}
+
+/* a CSV field, quoted */
+static std::string csv_quote(const std::string &text) {
+    std::string quoted = "\"";
+    for (std::string::size_type i = 0; i < text.size(); i++) {
+        if (text[i] == '"')
+            quoted += '"';
+        quoted += text[i];
+    }
+    return quoted + "\"";
+}
+
+/* a JSON string, quoted */
+static std::string json_quote(const std::string &text) {
+    std::string quoted = "\"";
+    for (std::string::size_type i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+/* A run that failed, because sim_create() refused its parameters or the */
+/* protocol its options, still gets its row: its parameters and error,   */
+/* with the results left empty.                                           */
+static bool failed(const run &r) {
+    return !r.results.error.empty();
+}
+
+static void write_csv(FILE *out) {
+    std::vector<std::string> names = series_names();
+    std::vector<bool> percentiles;
+    for (unsigned long k = 0; k < names.size(); k++)
+        percentiles.push_back(has_percentiles(names[k]));
+    fprintf(out, "protocol,seed,stream,window,messages,loss,corruption,interval,message_size,mtu,options,"
+            "A_application,A_transport,B_transport,B_application,total_time,throughput,throughput_bytes,"
+            "B_application_sent,B_transport_sent,A_transport_received,A_application_received,reverse_throughput,"
+            "reverse_throughput_bytes,"
+            "A_deferred,A_dropped,B_deferred,B_dropped,events_peak,wall_seconds,error");
+    for (unsigned long k = 0; k < names.size(); k++) {
+        const char *name = names[k].c_str();
+        fprintf(out, ",%s_n,%s_mean,%s_sd", name, name, name);
+        if (percentiles[k])
+            fprintf(out, ",%s_p50,%s_p90,%s_p99", name, name, name);
+    }
+    fprintf(out, "\n");
+    for (unsigned long i = 0; i < runs.size(); i++) {
+        const run &r = runs[i];
+        const struct sim_direction &ba = r.results.B_to_A;
+        fprintf(out, "%s,%d,%u,%d,%d,%g,%g,%g,%d,%d,%s",
+                r.protocol.c_str(), r.params.seed, r.params.stream, r.params.winsize, r.params.nsimmax,
+                r.params.lossprob, r.params.corruptprob, r.params.lambda, r.params.msgsize, r.results.mtu,
+                csv_quote(r.params.options).c_str());
+        if (failed(r))
+            fprintf(out, ",,,,,,,,,,,,,,,,,,");
+        else
+            fprintf(out, ",%d,%d,%d,%d,%f,%f,%f,%d,%d,%d,%d,%f,%f,%d,%d,%d,%d,%lu",
+                    r.results.A_application, r.results.A_transport,
+                    r.results.B_transport, r.results.B_application,
+                    r.results.time, r.results.B_application / r.results.time,
+                    r.results.B_application_bytes / r.results.time,
+                    ba.application_sent, ba.transport_sent, ba.transport_received, ba.application_received,
+                    ba.application_received / r.results.time, ba.application_bytes_received / r.results.time,
+                    r.results.A_deferred, r.results.A_dropped, ba.application_deferred, ba.application_dropped,
+                    r.results.events_peak);
+        fprintf(out, ",%f,%s", r.wall, csv_quote(r.results.error).c_str());
+        for (unsigned long k = 0; k < names.size(); k++) {
+            const struct sim_series *st = find_series(r, names[k]);
+            if (st != NULL)
+                fprintf(out, ",%lu,%f,%f", st->count, st->mean(), st->deviation());
+            else
+                fprintf(out, ",0,,");
+            if (percentiles[k] && st != NULL && st->has_percentiles())
+                fprintf(out, ",%f,%f,%f", st->percentile(50), st->percentile(90), st->percentile(99));
+            else if (percentiles[k])
+                fprintf(out, ",,,");
+        }
+        fprintf(out, "\n");
+    }
+}
+
+static void write_json(FILE *out) {
+    fprintf(out, "[\n");
+    for (unsigned long i = 0; i < runs.size(); i++) {
+        const run &r = runs[i];
+        const struct sim_direction &ba = r.results.B_to_A;
+        fprintf(out, "  {\"protocol\": \"%s\", \"seed\": %d, \"stream\": %u, \"window\": %d, \"messages\": %d, "
+                        "\"loss\": %g, \"corruption\": %g, \"interval\": %g, \"message_size\": %d, \"mtu\": %d, "
+                        "\"options\": %s, ",
+                r.protocol.c_str(), r.params.seed, r.params.stream, r.params.winsize, r.params.nsimmax,
+                r.params.lossprob, r.params.corruptprob, r.params.lambda, r.params.msgsize, r.results.mtu,
+                json_quote(r.params.options).c_str());
+        if (failed(r))
+            fprintf(out, "\"error\": %s, ", json_quote(r.results.error).c_str());
+        else
+            fprintf(out, "\"A_application\": %d, \"A_transport\": %d, \"B_transport\": %d, \"B_application\": %d, "
+                            "\"total_time\": %f, \"throughput\": %f, \"throughput_bytes\": %f, "
+                            "\"B_application_sent\": %d, \"B_transport_sent\": %d, "
+                            "\"A_transport_received\": %d, \"A_application_received\": %d, \"reverse_throughput\": %f, "
+                            "\"reverse_throughput_bytes\": %f, "
+                            "\"A_deferred\": %d, \"A_dropped\": %d, \"B_deferred\": %d, \"B_dropped\": %d, "
+                            "\"events_peak\": %lu, ",
+                    r.results.A_application, r.results.A_transport,
+                    r.results.B_transport, r.results.B_application,
+                    r.results.time, r.results.B_application / r.results.time,
+                    r.results.B_application_bytes / r.results.time,
+                    ba.application_sent, ba.transport_sent, ba.transport_received, ba.application_received,
+                    ba.application_received / r.results.time, ba.application_bytes_received / r.results.time,
+                    r.results.A_deferred, r.results.A_dropped, ba.application_deferred, ba.application_dropped,
+                    r.results.events_peak);
+        fprintf(out, "\"wall_seconds\": %f, \"stats\": {", r.wall);
+        for (unsigned long k = 0; k < r.results.stats.size(); k++) {
+            const struct sim_series &st = r.results.stats[k];
+            fprintf(out, "%s\"%s\": {\"n\": %lu, \"mean\": %f, \"sd\": %f, \"min\": %f, \"max\": %f",
+                    k ? ", " : "", st.name.c_str(), st.count, st.mean(), st.deviation(), st.min, st.max);
+            if (st.has_percentiles())
+                fprintf(out, ", \"p50\": %f, \"p90\": %f, \"p99\": %f",
+                        st.percentile(50), st.percentile(90), st.percentile(99));
+            fprintf(out, "}");
+        }
+        fprintf(out, "}}%s\n", i + 1 < runs.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+static void display_usage(char *filename) {
+    printf("Usage:\n %s [-p Protocols] [-s Seeds] [-n Random streams] [-w Window sizes] [-m Messages] [-l Losses] "
+           "[-c Corruptions] [-t Average times between messages] [-z Message sizes] [-q Event queue] "
+           "[-r Random generator] [-M MTU] [-P Protocol option sets] [-d] [-B defer|drop] [-j Threads] "
+           "[-o csv|json] [-f Output file]\n"
+           " Each grid option takes a list \"a,b,c\" or a range \"first:last[:step]\".\n"
+           " Defaults: -p abt,gbn,sr -s 1 -n 0 -w 10 -m 1000 -l 0 -c 0 -t 50 -z 20 -r xoshiro, each run's\n"
+           " largest message and its header as -M, one thread per core,\n"
+           " CSV on stdout.  -d makes every run bidirectional.  -P takes option sets separated by ';',\n"
+           " each \"name[=value],...\" as for -P of abt, gbn and sr.  -B is what layer 5 does while a\n"
+           " sender is full, as for abt, gbn and sr.\n",
+           filename);
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> protocols = parse_names("abt,gbn,sr");
+    std::vector<std::string> option_sets(1, "");
+    std::vector<double> seeds(1, 1), streams(1, 0), windows(1, 10), messages(1, 1000),
+            losses(1, 0), corruptions(1, 0), intervals(1, 50), sizes(1, 20);
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *format = "csv", *path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:s:n:w:m:l:c:t:z:M:P:q:r:dB:j:o:f:")) != -1) {
+        switch (opt) {
+            case 'p':   protocols = parse_names(optarg);
+                        break;
+            case 's':   seeds = parse_list(optarg, opt);
+                        break;
+            case 'n':   streams = parse_list(optarg, opt);
+                        break;
+            case 'w':   windows = parse_list(optarg, opt);
+                        break;
+            case 'm':   messages = parse_list(optarg, opt);
+                        break;
+            case 'l':   losses = parse_list(optarg, opt);
+                        break;
+            case 'c':   corruptions = parse_list(optarg, opt);
+                        break;
+            case 't':   intervals = parse_list(optarg, opt);
+                        break;
+            case 'z':   sizes = parse_list(optarg, opt);
+                        break;
+            case 'M':   mtu = atoi(optarg);
+                        break;
+            case 'P':   option_sets = parse_option_sets(optarg);
+                        break;
+            case 'q':   queue = optarg;
+                        break;
+            case 'r':   generator = optarg;
+                        break;
+            case 'd':   bidirectional = 1;
+                        break;
+            case 'B':   layer5 = optarg;
+                        break;
+            case 'j':   threads = atol(optarg);
+                        break;
+            case 'o':   format = optarg;
+                        break;
+            case 'f':   path = optarg;
+                        break;
+            case '?':
+            default:    display_usage(argv[0]);
+                        return -1;
+        }
+    }
+    if (threads < 1 || *std::min_element(sizes.begin(), sizes.end()) < 1 ||
+            (strcmp(format, "csv") != 0 && strcmp(format, "json") != 0)) {
+        display_usage(argv[0]);
+        return -1;
+    }
+
+    for (unsigned long p = 0; p < protocols.size(); p++)
+        for (unsigned long s = 0; s < seeds.size(); s++)
+            for (unsigned long n = 0; n < streams.size(); n++)
+                for (unsigned long w = 0; w < windows.size(); w++)
+                    for (unsigned long m = 0; m < messages.size(); m++)
+                        for (unsigned long l = 0; l < losses.size(); l++)
+                            for (unsigned long c = 0; c < corruptions.size(); c++)
+                                for (unsigned long t = 0; t < intervals.size(); t++)
+                                    for (unsigned long z = 0; z < sizes.size(); z++)
+                                        for (unsigned long o = 0; o < option_sets.size(); o++) {
+                                            run r;
+                                            memset(&r.params, 0, sizeof(r.params));
+                                            r.protocol = protocols[p];
+                                            r.params.seed = (int) seeds[s];
+                                            r.params.stream = (unsigned int) streams[n];
+                                            r.params.winsize = (int) windows[w];
+                                            r.params.nsimmax = (int) messages[m];
+                                            r.params.lossprob = losses[l];
+                                            r.params.corruptprob = corruptions[c];
+                                            r.params.lambda = intervals[t];
+                                            r.params.msgsize = (int) sizes[z];
+                                            r.params.mtu = mtu;
+                                            r.params.trace = 0;
+                                            r.params.queue = queue;
+                                            r.params.rng = generator;
+                                            r.params.bidirectional = bidirectional;
+                                            r.params.layer5 = layer5;
+                                            r.params.options = option_sets[o].c_str();
+                                            runs.push_back(r);
+                                        }
+
+    /* -q, -r and -B are the same for every run, so one probe checks them; */
+    /* runs whose stream, message size or MTU do not fit fail on their own */
+    struct sim_params probe = runs[0].params;
+    probe.stream = 0;
+    probe.msgsize = probe.mtu = 0;
+    std::string error;
+    struct simulation *sim = sim_create(&probe, find_protocol(runs[0].protocol.c_str()), &error);
+    if (sim == NULL) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return -1;
+    }
+    sim_destroy(sim);
+
+    if ((unsigned long) threads > runs.size())
+        threads = runs.size();
+    deques.resize(threads);
+    for (long i = 0; i < threads; i++)
+        pthread_mutex_init(&deques[i].lock, NULL);
+    for (unsigned long i = 0; i < runs.size(); i++)
+        deques[i % threads].tasks.push_back(i);
+
+    double start = now();
+    std::vector<pthread_t> workers(threads);
+    for (long i = 0; i < threads; i++)
+        pthread_create(&workers[i], NULL, worker, (void *) i);
+    for (long i = 0; i < threads; i++)
+        pthread_join(workers[i], NULL);
+    fprintf(stderr, "%lu runs on %ld threads in %.3f s\n", (unsigned long) runs.size(), threads, now() - start);
+    unsigned long nfailed = std::count_if(runs.begin(), runs.end(), failed);
+    if (nfailed > 0)
+        fprintf(stderr, "%lu runs failed, see the error column\n", nfailed);
+
+    FILE *out = stdout;
+    if (path != NULL && (out = fopen(path, "w")) == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (strcmp(format, "json") == 0)
+        write_json(out);
+    else
+        write_csv(out);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <climits>
+
+#include "../include/transport.h"
+#include "../include/coalesce.h"
+#include "../include/fec.h"
+
+bool get_transport_options(struct simulation *sim, struct transport_options *options)
+{
+    options->ackdelay = getoption(sim, "ackdelay", 0);
+    options->ackevery = (int) getoption(sim, "ackevery", options->ackdelay > 0 ? INT_MAX : 1);
+    options->ackoutoforder = getoption(sim, "ackoutoforder") != NULL;
+    options->fastrecovery = getoption(sim, "fastrecovery") != NULL;
+    bool fastretransmit = options->fastrecovery || getoption(sim, "fastretransmit") != NULL;
+    options->dupthresh = (int) getoption(sim, "fastretransmit", fastretransmit ? 3 : 0);
+    options->sendbuffer = (int) getoption(sim, "sendbuffer", INT_MAX);
+    options->rcvbuffer = (int) getoption(sim, "rcvbuffer", getwinsize(sim));
+    options->readdelay = getoption(sim, "readdelay", 0);
+    options->coalescing = getoption(sim, "coalesce") != NULL;
+    options->coalescedelay = getoption(sim, "coalesce", 0);
+    options->feck = options->fecm = 0;
+    if (getoption(sim, "fec") != NULL) {
+        options->feck = (int) getoption(sim, "fec", 4);
+        options->fecm = (int) getoption(sim, "fecparity", 1);
+    }
+    options->cc = getoption(sim, "cc");
+    if (options->cc == NULL)
+        options->cc = "fixed";
+    options->checksum = CHECKSUM_SUM;
+
+    const char *type = getoption(sim, "checksum");
+    if (type != NULL && !checksum_type_of(type, &options->checksum))
+        sim_error(sim, "Unknown checksum: %s", type);
+    else if (options->ackevery < 1)
+        sim_error(sim, "Need ackevery >= 1");
+    else if (options->ackdelay < 0)
+        sim_error(sim, "Need ackdelay >= 0");
+    else if (options->dupthresh < 0)
+        sim_error(sim, "Need fastretransmit >= 0");
+    else if (options->sendbuffer < 1)
+        sim_error(sim, "Need sendbuffer >= 1");
+    else if (options->rcvbuffer < 1)
+        sim_error(sim, "Need rcvbuffer >= 1");
+    else if (options->readdelay < 0)
+        sim_error(sim, "Need readdelay >= 0");
+    else if (options->coalescedelay < 0)
+        sim_error(sim, "Need coalesce >= 0");
+    else if (getoption(sim, "fec") != NULL
+             && (options->fecm < 1 || options->feck < options->fecm || options->feck > 255))
+        sim_error(sim, "Need 1 <= fecparity <= fec <= 255");
+    else
+        return true;
+    return false;
+}
+
+/* coalesced packets leave room for the parity header in the coalesce */
+/* check, so fec has its own only without coalescing                  */
+bool transport_fits_mtu(struct simulation *sim, const struct transport_options &options, int payload)
+{
+    int mtu = 0;
+    if (options.coalescing)
+        mtu = PKT_HEADER + (options.feck > 0 ? FEC_HEADER : 0) + COALESCE_HEADER + COALESCE_RECORD + payload;
+    else if (options.feck > 0)
+        mtu = fec::parity_size(payload);
+    if (mtu <= getmtu(sim))
+        return true;
+    sim_error(sim, "Messages of %d bytes need an MTU of %d with %s", getmaxmsgsize(sim), mtu,
+              options.coalescing ? "coalesce" : "fec");
+    return false;
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Every message delivered to layer 5 gives exactly one delay sample, also
+# when message sizes vary (-z min-max) and the protocol reorders, coalesces
+# or rebuilds packets.  Usage: delay_samples.sh <directory of abt, gbn, sr>
+
+bin=${1:-.}
+status=0
+
+# samples of the series name in the -S report on stdin, 0 if none
+samples() {
+    sed -n "s/^ $1: \([0-9]*\) samples.*/\1/p" | grep . || echo 0
+}
+
+check() {
+    out=$("$bin/$1" -s 1 -w 4 -m 1500 -l 0.2 -c 0.2 -t 4 -v 0 -z 1-60 -M 200 -S $2) || {
+        echo "FAIL $1 $2: exit status $?"
+        status=1
+        return
+    }
+    delivered=$(echo "$out" | sed -n 's/^\[PA2\]\([0-9]*\) packets received at the Application layer of Receiver B.*/\1/p')
+    delay=$(echo "$out" | samples delay)
+    reverse=$(echo "$out" | sed -n 's/^ \([0-9]*\) packets received at the Application layer of Receiver A$/\1/p')
+    reverse_delay=$(echo "$out" | samples reverse_delay)
+    if [ "$delivered" != "$delay" ] || [ "${reverse:-0}" != "$reverse_delay" ]; then
+        echo "FAIL $1 $2: $delivered delivered, $delay delay samples; ${reverse:-0} delivered to A, $reverse_delay reverse_delay samples"
+        status=1
+    else
+        echo "ok   $1 $2: $delivered delivered"
+    fi
+}
+
+check abt ""
+check abt "-d"
+for p in gbn sr; do
+    check $p ""
+    check $p "-d"
+    check $p "-P coalesce=2"
+    check $p "-P fec=3"
+    check $p "-d -P fec=3,coalesce=1,readdelay=2"
+    check $p "-P cc=aimd,rcvbuffer=2,readdelay=3"
+done
+check sr "-P streams=3,fec=2"
+check sr "-d -P streams=4,sack,readdelay=1"
+
+exit $status